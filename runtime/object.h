@@ -0,0 +1,71 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+/// @file object.h
+/// @brief Layout of heap objects, shared by the compiler and the runtime
+///
+/// Every heap object starts with a header word:
+///
+///     63          32  31   30      8 7   5   4    3   2    0
+///     [    words    | wide | arity  | pad | utf8 | mark | type ]
+///
+/// - `words` is the size of the object in words, header included.
+/// - `arity` is the number of arguments a closure takes. Pairs, vectors and
+///   strings keep their allocation site there instead, when profiled.
+/// - `wide` is set on strings whose characters string-set! moved to cells.
+/// - `pad` is the number of bytes left unused at the end of a string.
+/// - `utf8` is set on strings that hold non ASCII characters.
+/// - `mark` is set by collectors on objects they reach but don't move.
+/// - `type` is the tag of references to the object. A copying collector
+///   overwrites the header with the address of the copy, which leaves it 0.
+///
+/// The fields follow the header, so that the size of any object and where its
+/// references are can be told from its first word alone, and a space can be
+/// walked object by object. Strings start with the number of code points they
+/// hold, ahead of their UTF-8 bytes. Wide strings hold a reference instead,
+/// to a string without flags of 32 bit cells, each the UTF-8 bytes of a
+/// character as characters hold them, first byte lowest.
+
+/// Types, the same as pointer tags
+#define OBJ_PAIR 1
+#define OBJ_VEC 2
+#define OBJ_STR 3
+/// Mutable variable captured by a closure, referenced by the address of its
+/// value rather than a tagged pointer
+#define OBJ_BOX 4
+#define OBJ_SYMB 5
+#define OBJ_LAMB 6
+
+#define HDR_TYPE 7
+#define HDR_MARK 8
+#define HDR_UTF8 16
+#define HDR_WIDE ((size_t)1 << 31)
+#define HDR_PAD_SHIFT 5
+#define HDR_ARITY_SHIFT 8
+#define HDR_WORDS_SHIFT 32
+
+/// Header of an object of `words` words, flags aside
+#define make_hdr(type, words) ((size_t)(words) << HDR_WORDS_SHIFT | (type))
+#define hdr_type(hdr) ((hdr) & HDR_TYPE)
+#define hdr_words(hdr) ((hdr) >> HDR_WORDS_SHIFT)
+#define hdr_arity(hdr) (((hdr) >> HDR_ARITY_SHIFT) & 0x7fffff)
+/// Allocation site of a pair, vector or string, numbered from 1 in programs
+/// compiled with --profile-alloc, 0 if unknown
+#define hdr_site(hdr) hdr_arity(hdr)
+/// Last site numbered, so that headers stay buildable from 32 bit immediates
+#define SITE_MAX (((size_t)1 << 23) - 1)
+/// Length of a string in bytes
+#define hdr_bytes(hdr)                                                         \
+  ((hdr_words(hdr) - 2) * sizeof(size_t) - (((hdr) >> HDR_PAD_SHIFT) & 7))
+
+/// Heap snapshots, written by the runtime and read by ilish-heapstat, are
+/// native words:
+///
+/// - the magic, then the number of allocation sites, and 4 words for each:
+///   objects and bytes allocated, line, and type
+/// - the number of roots, then the address of each object they reference
+/// - until the end, a record for each object: its address, header, the number
+///   of references it holds into the heap, and the address of each
+#define HEAP_DUMP_MAGIC 0x31706d6468736c69 // "ilshdmp1"
+
+#endif // OBJECT_H
@@ -1,10 +1,36 @@
 /// Generational Copying GC Runtime
 /// Also currently implements print as a last program statement
+#include <immintrin.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
-#define MIN(x, y) ((x > y) ? y : x)
+#include "object.h"
+
+/// Entry points called from compiled code, which doesn't keep the stack
+/// aligned to 16 bytes as libc expects
+#define ENTRY __attribute__((force_align_arg_pointer))
+
+/// Address space reserved up front for each half of a generation. Only the
+/// part in use is committed, so these only cost virtual memory.
+#define NURSERY_MAX ((size_t)1 << 30)
+#define GEN1_MAX ((size_t)1 << 34)
+#define RS_MAX ((size_t)1 << 26)
+#define REMSET_LEN ((size_t)1 << 16)
+/// Objects of at least this many bytes go to the large object space
+#define LARGE_SIZE ((size_t)1 << 15)
+#define LOS_MAX ((size_t)1 << 36)
+/// Large objects allocated before a major collection is forced, at least
+#define LOS_TRIGGER ((size_t)1 << 25)
+/// Transparent huge page size the generations are aligned to
+#define HUGE_PAGE ((size_t)1 << 21)
 
 char *gen0_begin = 0;
 char *gen0_ptr;
@@ -14,195 +40,2511 @@ char *gen1_ptr;
 char *gen1_tospace;
 size_t **rs_begin = 0;
 
-/// One time allocation with distributed heaps for both generation.
-// HACK: !gen0_begin, !rs_begin may seem like pointless checks, but for some
-// reason the executable runs this function at the end of the program, while
-// also running it at the start as is the expected behaviour.
-// Thus, they are set to 0 at the start of the program, and to 1 when cleanup is
-// called which ensures no magic 77KB mallocs when a unit vector program is
-// already long complete.
-void init_gc(size_t rs_size, size_t heap_size) {
+char *heap_begin;
+size_t heap_len;
+size_t page_size;
+/// Whether the generations are backed by transparent huge pages, with
+/// ILISH_HUGEPAGES, and the nursery faulted in up front, with ILISH_PREFAULT
+char huge_pages;
+char prefault;
+/// Committed size of each half of a generation
+size_t gen0_size;
+size_t gen1_size;
+/// Size each nursery half grows to at most when its survivors crowd it
+#define NURSERY_CAP ((size_t)1 << 22)
+size_t gen0_cap;
+/// Minor collections in a row that kept survivors in the nursery, which the
+/// next collection promotes once it reaches TENURE_AGE
+#define TENURE_AGE 2
+size_t gen0_age;
+
+/// Both halves of gen0, read by the write barrier
+char *nursery_lo = 0;
+size_t nursery_len = 0;
+/// Remembered set of old slots that were made to point into gen0
+size_t **remset_begin;
+size_t **remset_ptr;
+size_t **remset_end;
+char remset_full;
+
+#define CARD_SHIFT 9
+/// Card table over both gen1 spaces, a byte per card, read by the card barrier
+char *card_base = 0;
+size_t card_len = 0;
+char *card_table;
+/// Offset in words of the last object that starts in each card of gen1, plus
+/// one, 0 if none does, so that objects can be found from a dirty card
+char *card_starts;
+/// End of gen1 before the current collection promoted into it
+char *card_end;
+/// End of gen1 before its spaces last swapped, below which the cards of the
+/// tospace are yet to be cleared, 0 once they are
+char *card_stale;
+
+/// Regions being evacuated by the current collection
+char *from_lo[2];
+char *from_hi[2];
+/// Where copies of this collection start, and the end of their space
+char *copy_begin;
+char *copy_limit;
+/// Cheney scan of to-space, everything copied below it has had its
+/// references forwarded
+char *scan_ptr;
+/// Large objects reached but not yet scanned, as they are not in to-space
+size_t *los_grey;
+size_t los_grey_len;
+
+/// Large object space, a run of pages per object that is never moved and is
+/// marked in its header and swept by major collections instead.
+/// Runs are laid out back to back, each described at its first page.
+enum los_state { LosFree, LosUsed };
+char *los_base;
+/// Pages in use or on the free runs
+size_t los_top;
+size_t *los_pages;
+char *los_state;
+/// Bytes held by large objects, and how many before the next major
+size_t los_bytes;
+size_t los_trigger;
+/// Large vectors allocated since gen0 was last emptied, filled without a
+/// barrier, which minor collections scan whole
+size_t *los_young;
+size_t los_young_len;
+size_t los_young_cap;
+/// Whether the collection in progress marks large objects
+char los_marking;
+char major_pending;
+
+/// Incremental collection of gen1, enabled by ILISH_GC_BUDGET, the pause
+/// target in microseconds.
+/// Rather than copied in one major pause, gen1 is replicated into its tospace
+/// a slice at a time on each minor collection, while the program keeps using
+/// the originals. Slots the write barrier logs meanwhile are copied over to
+/// the replicas, and once every reachable object has one, a last minor
+/// collection flips the roots and nursery over to them.
+#define INC_LOG_LEN ((size_t)1 << 20)
+/// Eighths of gen1 in use after a promotion that start a cycle
+#define INC_START 4
+/// Objects a slice scans between looks at the clock
+#define INC_BATCH 32
+/// Nursery bytes per microsecond of the budget, as copying its survivors
+/// takes most of a pause
+#define INC_NURSERY_RATE 256
+size_t inc_budget;
+/// Whether a cycle runs, read by the write barrier
+char inc_active;
+char inc_flipping;
+/// Slots written during the cycle, a full log making the next collection a
+/// major one that gives up on the cycle
+size_t **inc_log_begin;
+size_t **inc_log_ptr;
+size_t **inc_log_end;
+/// Replicas, and the replica of each gen1 word that starts an object
+char *rep_begin;
+char *rep_ptr;
+/// The table is zero below the top of gen1, as whatever fills gen1 clears its
+/// part, so that cycles start without clearing it all
+size_t *fwd_table;
+/// Replicas below it have been scanned
+char *rep_scan;
+int in_inc_from(char *obj);
+size_t inc_replicate(size_t val);
+size_t now_ns();
+
+/// Collector statistics, dumped at cleanup with ILISH_GC_STATS, and traced as
+/// a JSON line per collection with ILISH_GC_TRACE.
+/// Pauses are kept in power of two histograms of microseconds.
+#define PAUSE_BUCKETS 32
+enum gc_kind { Minor, Promote, Major };
+const char *gc_kind_names[] = {"minor", "promote", "major"};
+struct gc_stats {
+  size_t count[3];
+  size_t allocated;
+  size_t copied;
+  size_t promoted;
+  size_t pause_total[3];
+  size_t pause_max[3];
+  size_t pause_hist[3][PAUSE_BUCKETS];
+  size_t cycles;
+  size_t aborted;
+  size_t slices;
+  size_t replicated;
+  size_t over_budget;
+} stats;
+char stats_on;
+char trace_on;
+/// Where allocation in gen0 resumed after the last collection
+char *gen0_mark;
+/// Collections so far, which move objects that are looked up by address
+size_t gc_epoch;
+void free_indexes();
+
+/// Parallel major collection, enabled by ILISH_GC_THREADS above 1.
+/// Workers copy into buffers of their own taken from the gen1 tospace, and
+/// share grey objects through work stealing deques.
+#define TLAB_SIZE ((size_t)1 << 16)
+/// A buffer with less room left than this is retired rather than bypassed
+#define TLAB_WASTE 512
+#define MAX_GC_THREADS 64
+typedef struct {
+  long top;
+  long bottom;
+  size_t *buf;
+} deque_t;
+typedef struct {
+  deque_t deque;
+  char *ptr;
+  char *limit;
+  size_t promoted;
+  size_t id;
+  pthread_t thread;
+} worker_t;
+size_t gc_threads = 1;
+worker_t *workers;
+/// Shared bump pointer of to-space, and roots, of the parallel copy
+char *par_top;
+size_t par_roots;
+size_t par_idle;
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+size_t pool_epoch;
+size_t pool_running;
+char pool_exit;
+void init_workers();
+void stop_workers();
+
+/// Reserves address space that is neither readable nor writable yet
+void *reserve_space(size_t size, int prot) {
+  void *mem = mmap(0, size, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                   -1, 0);
+  if (mem == MAP_FAILED) {
+    perror("Failed to Reserve the Heap");
+    exit(1);
+  }
+  return mem;
+}
+
+/// Reserves address space aligned to `align`, a power of two, giving back
+/// what is left on either side
+void *reserve_aligned(size_t size, size_t align) {
+  char *mem = reserve_space(size + align, PROT_NONE);
+  char *begin = (char *)(((size_t)mem + align - 1) & ~(align - 1));
+  if (begin > mem) {
+    munmap(mem, begin - mem);
+  }
+  munmap(begin + size, mem + align - begin);
+  return begin;
+}
+
+/// Writes to every page of a committed range, so that the program does not
+/// take the faults later
+void fault_in(char *begin, size_t size) {
+#ifdef MADV_POPULATE_WRITE
+  if (!madvise(begin, size, MADV_POPULATE_WRITE)) {
+    return;
+  }
+#endif
+  for (size_t i = 0; i < size; i += page_size) {
+    begin[i] = 0;
+  }
+}
+
+/// Makes the first `size` bytes of a reserved space usable
+void commit_space(char *begin, size_t size) {
+  size = (size + page_size - 1) & ~(page_size - 1);
+  if (mprotect(begin, size, PROT_READ | PROT_WRITE)) {
+    perror("Failed to Commit the Heap");
+    exit(1);
+  }
+}
+
+/// Doubles `size` until it reaches `need`, within `max`
+size_t grow_size(size_t size, size_t need, size_t max) {
+  while (size < need && size < max) {
+    size <<= 1;
+  }
+  return size < max ? size : max;
+}
+
+/// Commits both halves of gen0 up to `size`
+void resize_gen0(size_t size) {
+  if (size > gen0_size) {
+    commit_space(nursery_lo, size);
+    commit_space(nursery_lo + NURSERY_MAX, size);
+    if (prefault) {
+      fault_in(nursery_lo + gen0_size, size - gen0_size);
+      fault_in(nursery_lo + NURSERY_MAX + gen0_size, size - gen0_size);
+    }
+    gen0_size = size;
+  }
+}
+
+/// Commits both halves of gen1 up to `size`
+void resize_gen1(size_t size) {
+  if (size > gen1_size) {
+    commit_space(card_base, size);
+    commit_space(card_base + GEN1_MAX, size);
+    gen1_size = size;
+  }
+}
+
+/// Parses a size in bytes with an optional k, m or g suffix
+/// @return The size, 0 if it is unset or malformed.
+size_t getenv_size(const char *name) {
+  const char *str = getenv(name);
+  if (!str) {
+    return 0;
+  }
+  char *end;
+  size_t size = strtoull(str, &end, 10);
+  switch (*end) {
+  case 'k':
+  case 'K':
+    size <<= 10;
+    end++;
+    break;
+  case 'm':
+  case 'M':
+    size <<= 20;
+    end++;
+    break;
+  case 'g':
+  case 'G':
+    size <<= 30;
+    end++;
+    break;
+  }
+  if (*end) {
+    fprintf(stderr, "Ignoring Malformed %s\n", name);
+    return 0;
+  }
+  return size;
+}
+
+/// Heap snapshots, written at the first collection call after a SIGUSR1 to
+/// ilish-PID-N.heap, and at exit to the file ILISH_HEAP_DUMP_ON_EXIT names
+volatile sig_atomic_t dump_pending;
+size_t dumps;
+const char *dump_on_exit;
+/// Top of the root stack at the last collection call, below which roots stay
+/// valid until the next one
+size_t **rs_last;
+void dump_heap(size_t **rs_ptr, const char *path);
+
+void request_dump(int sig) {
+  (void)sig;
+  dump_pending = 1;
+}
+
+/// One time reservation of the heaps for both generation.
+/// `heap_size` is only the initial footprint, the generations grow as their
+/// survivors need.
+/// ILISH_HEAP overrides the compiled in `heap_size`, and ILISH_NURSERY fixes
+/// the size of each nursery half, which is otherwise an eighth of it and grows
+/// up to NURSERY_CAP if that is smaller. A budget caps it at INC_NURSERY_RATE
+/// bytes per microsecond instead.
+/// The generations start on huge page boundaries, which are also theirs as
+/// the maximum sizes are multiples of it.
+ENTRY void init_gc(size_t rs_size, size_t heap_size) {
+  (void)rs_size;
   if (!gen0_begin) {
-    gen0_begin = malloc(heap_size);
-    gen0_ptr = gen0_begin; // 0.125
-    gen0_tospace = gen0_begin + (heap_size >> 3);
-    // 0.125
-    gen1_begin = gen0_tospace + (heap_size >> 3);
-    gen1_ptr = gen1_begin; // 0.375
-    gen1_tospace = gen1_begin + (heap_size >> 2) + (heap_size >> 3);
-    // 0.375
+    size_t env_heap = getenv_size("ILISH_HEAP");
+    size_t env_nursery = getenv_size("ILISH_NURSERY");
+    heap_size = env_heap ? env_heap : heap_size;
+    size_t nursery = env_nursery ? env_nursery : heap_size >> 3;
+    nursery = nursery < NURSERY_MAX ? nursery : NURSERY_MAX;
+    page_size = sysconf(_SC_PAGESIZE);
+    huge_pages = getenv("ILISH_HUGEPAGES") != 0;
+    prefault = getenv("ILISH_PREFAULT") != 0;
+    heap_len = (NURSERY_MAX + GEN1_MAX) << 1;
+    heap_begin = reserve_aligned(heap_len, HUGE_PAGE);
+    // Only asks, THP may be disabled, or only allowed through madvise
+    if (huge_pages && madvise(heap_begin, heap_len, MADV_HUGEPAGE)) {
+      perror("Ignoring ILISH_HUGEPAGES");
+    }
+    nursery_lo = heap_begin;
+    nursery_len = NURSERY_MAX << 1;
+    card_base = heap_begin + nursery_len;
+    card_len = GEN1_MAX << 1;
+    // Spaces stay word aligned so that pointer tags survive
+    gen0_size = 0;
+    gen1_size = 0;
+    const char *budget = getenv("ILISH_GC_BUDGET");
+    inc_budget = budget ? strtoull(budget, 0, 10) * 1000 : 0;
+    if (inc_budget) {
+      inc_log_begin =
+          reserve_space(INC_LOG_LEN * sizeof(size_t *), PROT_READ | PROT_WRITE);
+      inc_log_ptr = inc_log_begin;
+      inc_log_end = inc_log_begin + INC_LOG_LEN;
+      fwd_table = reserve_space(card_len, PROT_READ | PROT_WRITE);
+    }
+    gen0_cap = inc_budget ? inc_budget / 1000 * INC_NURSERY_RATE : NURSERY_CAP;
+    if (inc_budget && !env_nursery && nursery > gen0_cap) {
+      nursery = gen0_cap;
+    }
+    gen0_cap = nursery > gen0_cap || env_nursery ? nursery : gen0_cap;
+    gen0_age = 0;
+    resize_gen0((nursery + 15) & ~(size_t)15);
+    size_t old = (heap_size >> 2) + (heap_size >> 3);
+    old = old < GEN1_MAX ? old : GEN1_MAX;
+    resize_gen1((old + 15) & ~(size_t)15);
+    gen0_begin = nursery_lo;
+    gen0_ptr = gen0_begin;
+    gen0_mark = gen0_begin;
+    gen0_tospace = nursery_lo + NURSERY_MAX;
+    gen1_begin = card_base;
+    gen1_ptr = gen1_begin;
+    gen1_tospace = card_base + GEN1_MAX;
+    // A full set is resolved by a major collection
+    remset_begin = malloc(REMSET_LEN * sizeof(*remset_begin));
+    remset_ptr = remset_begin;
+    remset_end = remset_begin + REMSET_LEN;
+    card_table = reserve_space(card_len >> CARD_SHIFT, PROT_READ | PROT_WRITE);
+    card_starts = reserve_space(card_len >> CARD_SHIFT, PROT_READ | PROT_WRITE);
+    los_base = reserve_space(LOS_MAX, PROT_NONE);
+    los_top = 0;
+    los_pages = reserve_space(LOS_MAX / page_size * sizeof(size_t),
+                              PROT_READ | PROT_WRITE);
+    los_state = reserve_space(LOS_MAX / page_size, PROT_READ | PROT_WRITE);
+    los_grey = reserve_space(LOS_MAX / page_size * sizeof(size_t),
+                             PROT_READ | PROT_WRITE);
+    los_bytes = 0;
+    los_trigger = LOS_TRIGGER;
+    los_young = 0;
+    los_young_len = 0;
+    los_young_cap = 0;
+    stats_on = getenv("ILISH_GC_STATS") != 0;
+    trace_on = getenv("ILISH_GC_TRACE") != 0;
+    const char *threads = getenv("ILISH_GC_THREADS");
+    gc_threads = threads ? strtoull(threads, 0, 10) : 1;
+    gc_threads = gc_threads ? gc_threads : 1;
+    gc_threads = gc_threads < MAX_GC_THREADS ? gc_threads : MAX_GC_THREADS;
+    if (gc_threads > 1) {
+      init_workers();
+    }
+    dump_on_exit = getenv("ILISH_HEAP_DUMP_ON_EXIT");
+    struct sigaction act = {.sa_handler = request_dump, .sa_flags = SA_RESTART};
+    sigaction(SIGUSR1, &act, 0);
   }
 
   if (!rs_begin) {
-    rs_begin = malloc(rs_size);
+    rs_begin = reserve_space(RS_MAX, PROT_READ | PROT_WRITE);
   }
+  rs_last = rs_begin;
 }
 
-void cleanup() {
-  if (gen0_tospace > gen0_begin) {
-    free(gen0_begin);
-    gen0_begin = (char *)1;
-  } else {
-    free(gen0_tospace);
-    gen0_tospace = (char *)1;
+/// Prints the statistics gathered over the run to stderr
+void print_stats() {
+  stats.allocated += gen0_ptr - gen0_mark;
+  fprintf(stderr,
+          "GC: %zu minor (%zu promoting), %zu major\n"
+          "Allocated %zu bytes, copied %zu, promoted %zu\n"
+          "Heap: %zu bytes of gen0, %zu of gen1, %zu large\n",
+          stats.count[Minor] + stats.count[Promote], stats.count[Promote],
+          stats.count[Major], stats.allocated, stats.copied, stats.promoted,
+          gen0_size << 1, gen1_size << 1, los_bytes);
+  if (inc_budget) {
+    fprintf(stderr,
+            "Incremental: %zu cycles (%zu aborted), %zu slices, replicated "
+            "%zu bytes, %zu pauses over the %zu us budget\n",
+            stats.cycles, stats.aborted, stats.slices, stats.replicated,
+            stats.over_budget, inc_budget / 1000);
+  }
+  for (int kind = Minor; kind <= Major; kind++) {
+    if (!stats.count[kind]) {
+      continue;
+    }
+    fprintf(stderr, "%s pauses: total %zu us, max %zu us\n",
+            gc_kind_names[kind], stats.pause_total[kind] / 1000,
+            stats.pause_max[kind] / 1000);
+    for (size_t b = 0; b < PAUSE_BUCKETS; b++) {
+      if (stats.pause_hist[kind][b]) {
+        fprintf(stderr, "  < %zu us: %zu\n", (size_t)1 << b,
+                stats.pause_hist[kind][b]);
+      }
+    }
+  }
+}
+
+/// Allocation site counters of a program compiled with --profile-alloc,
+/// bumped by its code and dumped at cleanup
+typedef struct {
+  size_t objects;
+  size_t bytes;
+  size_t line;
+  size_t type;
+} alloc_site_t;
+alloc_site_t *alloc_sites;
+size_t alloc_sites_len;
+
+ENTRY void init_profile(alloc_site_t *sites, size_t len) {
+  alloc_sites = sites;
+  alloc_sites_len = len;
+}
+
+int cmp_sites(const void *a, const void *b) {
+  const alloc_site_t *x = a;
+  const alloc_site_t *y = b;
+  return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+/// Prints the sites that allocated, most bytes first
+void print_profile() {
+  const char *names[] = {[OBJ_PAIR] = "pair", [OBJ_VEC] = "vector",
+                         [OBJ_STR] = "string", [OBJ_LAMB] = "closure"};
+  qsort(alloc_sites, alloc_sites_len, sizeof(*alloc_sites), cmp_sites);
+  // Set apart from the output of the program, which need not end a line
+  fflush(stdout);
+  fprintf(stderr, "\nAllocation sites\n%8s %-8s %12s %14s\n", "line", "type",
+          "objects", "bytes");
+  for (size_t i = 0; i < alloc_sites_len && alloc_sites[i].objects; i++) {
+    fprintf(stderr, "%8zu %-8s %12zu %14zu\n", alloc_sites[i].line,
+            names[alloc_sites[i].type], alloc_sites[i].objects,
+            alloc_sites[i].bytes);
+  }
+}
+
+/// Releases the heap at exit, after the snapshot of ILISH_HEAP_DUMP_ON_EXIT,
+/// whose roots are those on the root stack below `rs_ptr`
+ENTRY void cleanup(size_t **rs_ptr) {
+  if (stats_on && gen0_begin != (char *)1) {
+    print_stats();
+  }
+  if (dump_on_exit && gen0_begin != (char *)1) {
+    dump_heap(rs_ptr, dump_on_exit);
+    dump_on_exit = 0;
+  }
+  if (alloc_sites) {
+    print_profile();
+    alloc_sites = 0;
+  }
+  munmap(heap_begin, heap_len);
+  free(remset_begin);
+  munmap(card_table, card_len >> CARD_SHIFT);
+  munmap(card_starts, card_len >> CARD_SHIFT);
+  if (gc_threads > 1) {
+    stop_workers();
+    gc_threads = 1;
   }
-  free(rs_begin);
+  munmap(los_base, LOS_MAX);
+  munmap(los_pages, LOS_MAX / page_size * sizeof(size_t));
+  munmap(los_state, LOS_MAX / page_size);
+  munmap(los_grey, LOS_MAX / page_size * sizeof(size_t));
+  if (inc_budget) {
+    munmap(inc_log_begin, INC_LOG_LEN * sizeof(size_t *));
+    munmap(fwd_table, card_len);
+    inc_budget = 0;
+  }
+  free(los_young);
+  free_indexes();
+  gen0_begin = (char *)1;
+  munmap(rs_begin, RS_MAX);
   rs_begin = (size_t **)1;
 }
 
-int exists_root(size_t **rs_ptr, size_t target) {
-  for (size_t i = 0; i < (size_t)(rs_ptr - rs_begin); i++) {
-    if (target == (size_t)rs_begin[i])
-      return 1;
+/// Clears the cards over the part of gen1 in use, and over the tospace as it
+/// was before the spaces swapped
+void clear_cards() {
+  size_t card = (size_t)1 << CARD_SHIFT;
+  memset(card_table + ((gen1_begin - card_base) >> CARD_SHIFT), 0,
+         (gen1_ptr - gen1_begin + card - 1) >> CARD_SHIFT);
+  if (card_stale) {
+    memset(card_table + ((gen1_tospace - card_base) >> CARD_SHIFT), 0,
+           (card_stale - gen1_tospace + card - 1) >> CARD_SHIFT);
+    card_stale = 0;
   }
-  return 0;
 }
 
-/// TODO: These are simplified algorithms, they do not track pointers
-void copy(size_t **rs_ptr, char **ptr) {
-  for (size_t i = 0; i < (size_t)(rs_ptr - rs_begin); i++) {
-    switch ((size_t)(rs_begin[i]) & 0x7) {
-    case 1: // Pair
-      memcpy(*ptr, (void *)(((size_t)rs_begin[i]) - 1), sizeof(size_t) * 2);
-      rs_begin[i] = (size_t *)(*ptr + 1);
-      *ptr += sizeof(size_t) * 2;
-      break;
-    case 2: // Vec
-      memcpy(*ptr, (void *)(((size_t)rs_begin[i]) - 2),
-             sizeof(size_t) + (sizeof(size_t) >> 2) *
-                                  ((size_t *)(((size_t)rs_begin[i]) - 2))[0]);
-      rs_begin[i] = (size_t *)(*ptr + 2);
-      *ptr += sizeof(size_t) + (sizeof(size_t) >> 2) *
-                                   ((size_t *)(((size_t)rs_begin[i]) - 2))[0];
-      break;
-    case 3: // Str
-      memcpy(*ptr, (void *)(((size_t)rs_begin[i]) - 3),
-             sizeof(size_t) +
-                 (((size_t *)(((size_t)rs_begin[i]) - 3))[0] >> 3));
-      rs_begin[i] = (size_t *)(*ptr + 3);
-      *ptr +=
-          sizeof(size_t) + (((size_t *)(((size_t)rs_begin[i]) - 3))[0] >> 3);
-      break;
-    case 5: // Symb
-      break;
-      // FIX: The way Lamb is allocated contains no len data anymore
-    case 6: // Lamb
-      memcpy(*ptr, (void *)(((size_t)rs_begin[i]) - 6),
-             sizeof(size_t) + sizeof(size_t)); // * len like in Vec or Str
-      rs_begin[i] = (size_t *)(*ptr + 6);
-      *ptr += sizeof(size_t) + sizeof(size_t);
-      break;
-    default:
+/// Size in bytes of an object, from its header
+size_t hdr_size(size_t hdr) { return hdr_words(hdr) * sizeof(size_t); }
+
+/// Size in bytes of the object behind a tagged pointer
+size_t obj_size(size_t val) {
+  return hdr_size(*(size_t *)(val & ~(size_t)7));
+}
+
+/// Finds the words of an object that hold references, as [first, last)
+/// @return Whether it holds any.
+int obj_fields(size_t val, size_t *first, size_t *last) {
+  size_t *obj = (size_t *)(val & ~(size_t)7);
+  switch (hdr_type(obj[0])) {
+  case OBJ_PAIR:
+  case OBJ_VEC:
+  case OBJ_BOX:
+    *first = 1;
+    break;
+  case OBJ_LAMB: // Skipping the code pointer
+    *first = 2;
+    break;
+  case OBJ_STR: // Only wide ones, through their cells
+    if (!(obj[0] & HDR_WIDE)) {
+      return 0;
+    }
+    *first = 2;
+    *last = 3;
+    return 1;
+  default:
+    return 0;
+  }
+  *last = hdr_words(obj[0]);
+  return 1;
+}
+
+/// Records that an object starts at `obj` in gen1
+void note_start(char *obj) {
+  size_t offset = obj - card_base;
+  card_starts[offset >> CARD_SHIFT] =
+      (offset & ((1 << CARD_SHIFT) - 1)) / sizeof(size_t) + 1;
+}
+
+/// Finds the object of gen1 that holds the byte at `addr`, walking from the
+/// last one that starts in a card before it, or from the start of gen1
+char *obj_start(char *addr) {
+  size_t lo = (gen1_begin - card_base) >> CARD_SHIFT;
+  char *obj = gen1_begin;
+  for (size_t c = (addr - card_base) >> CARD_SHIFT; c > lo; c--) {
+    if (!card_starts[c]) {
+      continue;
+    }
+    char *last =
+        card_base + (c << CARD_SHIFT) + (card_starts[c] - 1) * sizeof(size_t);
+    if (last <= addr) {
+      obj = last;
       break;
     }
   }
+  while (obj + hdr_size(*(size_t *)obj) <= addr) {
+    obj += hdr_size(*(size_t *)obj);
+  }
+  return obj;
 }
 
-/// Copying collection
-/// NOTE: This version seems to work,
-/// but is still not tested as heavily as I would like
-void collect(size_t **rs_ptr, size_t request) {
-  // 0. Check
-  size_t gen0_left = ((gen0_tospace > gen0_begin)
-                          ? (gen0_tospace - gen0_ptr)
-                          : ((MIN(gen1_begin, gen1_tospace)) - gen0_ptr));
-  if (request >= gen0_left) {
-    // 1. Copy all objs pointed to in rs to tospace.
-    // 2. Navigate tospace and Keep track of copied objects using rs.
-    gen0_ptr = gen0_tospace;
-    copy(rs_ptr, &gen0_ptr);
-    // 3. tospace = fromspace.
-    char *tmp = gen0_begin;
-    gen0_begin = gen0_tospace;
-    gen0_tospace = tmp;
-    // NOTE: Current implementation does not account for gen1 holding data
-    // pointing to gen0, this would probably require an additional set to hold
-    // these generation breaking pointers.
-    gen0_left = ((gen0_tospace > gen0_begin)
-                     ? (gen0_tospace - gen0_ptr)
-                     : ((MIN(gen1_begin, gen1_tospace)) - gen0_ptr));
-    if (request >= gen0_left) {
-      size_t gen1_left =
-          ((gen1_tospace > gen1_begin)
-               ? (gen1_tospace - gen1_ptr)
-               : ((gen1_begin - gen1_tospace) - (gen1_ptr - gen1_begin)));
-      size_t gen0_size =
-          ((gen0_tospace > gen0_begin) ? (gen0_tospace - gen0_begin)
-                                       : (gen0_begin - gen0_tospace));
-      // Copies all gen0 into gen1 and resets gen0
-      if ((request + gen0_size) >= gen1_left) {
-        // Repeat procedure for gen1
-        gen1_ptr = gen1_tospace;
-        copy(rs_ptr, &gen1_ptr);
-        char *tmp = gen1_begin;
-        gen1_begin = gen1_tospace;
-        gen1_tospace = tmp;
-        size_t gen1_size =
-            ((gen1_tospace > gen1_begin) ? (gen1_tospace - gen1_begin)
-                                         : (gen1_begin - gen1_tospace));
-        if ((request + gen0_size) >= gen1_size) {
-          puts("Not Enough Space on the Major Heap! "
-               "Please "
-               "Allocate a Larger Heap.");
-          cleanup();
-          exit(1);
-        }
-      } else {
-        // Just copy, there is enough space
-        copy(rs_ptr, &gen1_ptr);
+int in_from(char *obj) {
+  return (obj >= from_lo[0] && obj < from_hi[0]) ||
+         (obj >= from_lo[1] && obj < from_hi[1]);
+}
+
+/// Marks a reached large object, queueing it so that its references are
+/// forwarded as well
+void mark_large(size_t val, char *obj) {
+  if (obj < los_base || obj >= los_base + los_top * page_size) {
+    return;
+  }
+  size_t *hdr = (size_t *)obj;
+  if (!(*hdr & HDR_MARK)) {
+    *hdr |= HDR_MARK;
+    los_grey[los_grey_len++] = val;
+  }
+}
+
+/// Copies the object behind `val` unless it was already, overwriting its
+/// header with the address of the copy.
+/// @return The updated reference.
+size_t forward(size_t val, char **ptr) {
+  size_t tag = val & 7;
+  if (tag != 1 && tag != 2 && tag != 3 && tag != 6) {
+    return val;
+  }
+  char *obj = (char *)(val - tag);
+  if (!in_from(obj)) {
+    if (inc_flipping && in_inc_from(obj)) {
+      return inc_replicate(val);
+    }
+    if (los_marking) {
+      mark_large(val, obj);
+    }
+    return val;
+  }
+  size_t hdr = *(size_t *)obj;
+  if (!hdr_type(hdr)) {
+    return hdr + tag;
+  }
+  size_t size = hdr_size(hdr);
+  if (*ptr + size > copy_limit) {
+    puts("Not Enough Space on the Major Heap! "
+         "Please "
+         "Allocate a Larger Heap.");
+    cleanup(rs_last);
+    exit(1);
+  }
+  memcpy(*ptr, obj, size);
+  if (*ptr >= card_base && *ptr < card_base + card_len) {
+    note_start(*ptr);
+  }
+  if (copy_begin >= card_base && obj >= from_lo[0] && obj < from_hi[0]) {
+    stats.promoted += size;
+  }
+  *(size_t *)obj = (size_t)*ptr;
+  size_t new = (size_t)*ptr + tag;
+  *ptr += size;
+  return new;
+}
+
+/// Forwards the references held by an object that lie within [lo, hi)
+void scan_range(size_t val, size_t *lo, size_t *hi, char **ptr) {
+  size_t *obj = (size_t *)(val & ~(size_t)7);
+  size_t first;
+  size_t last;
+  if (!obj_fields(val, &first, &last)) {
+    return;
+  }
+  size_t *slot = obj + first > lo ? obj + first : lo;
+  size_t *end = obj + last < hi ? obj + last : hi;
+  for (; slot < end; slot++) {
+    *slot = forward(*slot, ptr);
+  }
+}
+
+/// Forwards every reference held by a copied object
+void scan(size_t val, char **ptr) {
+  scan_range(val, 0, (size_t *)-1, ptr);
+}
+
+/// Forwards the references in dirty cards of gen1, which the card barrier
+/// marked for slots made to point into gen0.
+/// Objects overlapping a card are walked from the one the card starts in.
+void scan_cards(char **ptr) {
+  size_t c_end = (card_end - card_base + (1 << CARD_SHIFT) - 1) >> CARD_SHIFT;
+  for (size_t c = (gen1_begin - card_base) >> CARD_SHIFT; c < c_end; c++) {
+    // Clean cards are skipped a word at a time
+    while (!(c & 7) && c + 8 <= c_end && !*(size_t *)(card_table + c)) {
+      c += 8;
+    }
+    if (c >= c_end || !card_table[c]) {
+      continue;
+    }
+    size_t *lo = (size_t *)(card_base + (c << CARD_SHIFT));
+    size_t *hi = lo + ((1 << CARD_SHIFT) / sizeof(size_t));
+    if ((char *)lo >= card_end || (char *)hi <= gen1_begin) {
+      continue;
+    }
+    // A card can straddle both gen1 spaces
+    char *obj = obj_start((char *)lo > gen1_begin ? (char *)lo : gen1_begin);
+    while (obj < (char *)hi && obj < card_end) {
+      size_t hdr = *(size_t *)obj;
+      scan_range((size_t)obj + hdr_type(hdr), lo, hi, ptr);
+      obj += hdr_size(hdr);
+    }
+  }
+}
+
+/// Scans to-space up to `*ptr` as it grows, and the large objects reached
+/// meanwhile, until there is nothing left to scan
+void drain(char **ptr) {
+  while (scan_ptr < *ptr || los_grey_len) {
+    while (scan_ptr < *ptr) {
+      size_t hdr = *(size_t *)scan_ptr;
+      scan((size_t)scan_ptr + hdr_type(hdr), ptr);
+      scan_ptr += hdr_size(hdr);
+    }
+    while (los_grey_len) {
+      scan(los_grey[--los_grey_len], ptr);
+    }
+  }
+}
+
+/// Cheney copy of everything in the from regions reachable from the root
+/// stack, to `*ptr` and up to `limit`.
+/// Each object is copied once, and references to it are updated through its
+/// forwarding pointer.
+/// @param remembered Whether the remembered slots are roots as well, which is
+/// the case when gen1 is not being collected.
+void copy(size_t **rs_ptr, char **ptr, char *limit, int remembered) {
+  copy_begin = *ptr;
+  copy_limit = limit;
+  scan_ptr = *ptr;
+  for (size_t i = 0; i < (size_t)(rs_ptr - rs_begin); i++) {
+    rs_begin[i] = (size_t *)forward((size_t)rs_begin[i], ptr);
+  }
+  if (remembered) {
+    for (size_t **slot = remset_begin; slot < remset_ptr; slot++) {
+      **slot = forward(**slot, ptr);
+    }
+    scan_cards(ptr);
+    for (size_t i = 0; i < los_young_len; i++) {
+      scan(los_young[i], ptr);
+    }
+  }
+  drain(ptr);
+  stats.copied += *ptr - copy_begin;
+}
+
+/// Fills a gap left in to-space with an empty vector of zeros, so that gen1
+/// stays walkable from the cards
+void fill_gap(char *begin, char *end) {
+  if (begin >= end) {
+    return;
+  }
+  memset(begin, 0, end - begin);
+  *(size_t *)begin = make_hdr(OBJ_VEC, (end - begin) / sizeof(size_t));
+}
+
+/// Takes `size` bytes of the shared to-space
+char *par_alloc_shared(size_t size) {
+  char *mem = __atomic_fetch_add(&par_top, size, __ATOMIC_RELAXED);
+  if (mem + size > copy_limit) {
+    puts("Not Enough Space on the Major Heap! "
+         "Please "
+         "Allocate a Larger Heap.");
+    exit(1);
+  }
+  return mem;
+}
+
+/// Allocates from the worker's buffer. Objects that don't fit one nearly
+/// full are still taken from it after a refill, and the others straight from
+/// the shared to-space.
+char *par_alloc(worker_t *w, size_t size) {
+  if (w->ptr + size > w->limit) {
+    if ((size_t)(w->limit - w->ptr) >= TLAB_WASTE || size > TLAB_SIZE) {
+      return par_alloc_shared(size);
+    }
+    fill_gap(w->ptr, w->limit);
+    w->ptr = par_alloc_shared(TLAB_SIZE);
+    w->limit = w->ptr + TLAB_SIZE;
+  }
+  char *mem = w->ptr;
+  w->ptr += size;
+  return mem;
+}
+
+/// Gives back a copy that lost the race to forward an object
+void par_unalloc(worker_t *w, char *mem, size_t size) {
+  if (mem + size == w->ptr) {
+    w->ptr = mem;
+  } else {
+    fill_gap(mem, mem + size);
+  }
+}
+
+/// Chase-Lev deque, the owner pushes and pops at the bottom while thieves
+/// take from the top. Indices only grow past what a collection pushes, so
+/// the buffer needs no wrapping.
+void deque_push(deque_t *d, size_t val) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  d->buf[b] = val;
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+/// @return The last pushed value, 0 if there is none.
+size_t deque_pop(deque_t *d) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&d->bottom, b, __ATOMIC_SEQ_CST);
+  long t = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+  if (t > b) {
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  size_t val = d->buf[b];
+  if (t == b) {
+    // The last value, which a thief may be taking as well
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_RELAXED)) {
+      val = 0;
+    }
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return val;
+}
+
+/// @return The first pushed value, 0 if there is none or another thread
+/// took it.
+size_t deque_steal(deque_t *d) {
+  long t = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST);
+  if (t >= b) {
+    return 0;
+  }
+  size_t val = d->buf[t];
+  if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST,
+                                   __ATOMIC_RELAXED)) {
+    return 0;
+  }
+  return val;
+}
+
+int deque_empty(deque_t *d) {
+  return __atomic_load_n(&d->top, __ATOMIC_SEQ_CST) >=
+         __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST);
+}
+
+/// forward() for a worker, which races the others to install the forwarding
+/// pointer, and pushes what it copied on its deque
+size_t par_forward(worker_t *w, size_t val) {
+  size_t tag = val & 7;
+  if (tag != 1 && tag != 2 && tag != 3 && tag != 6) {
+    return val;
+  }
+  char *obj = (char *)(val - tag);
+  if (!in_from(obj)) {
+    if (los_marking && obj >= los_base &&
+        obj < los_base + los_top * page_size &&
+        !(__atomic_fetch_or((size_t *)obj, HDR_MARK, __ATOMIC_RELAXED) &
+          HDR_MARK)) {
+      deque_push(&w->deque, val);
+    }
+    return val;
+  }
+  size_t hdr = __atomic_load_n((size_t *)obj, __ATOMIC_ACQUIRE);
+  if (!hdr_type(hdr)) {
+    return hdr + tag;
+  }
+  size_t size = hdr_size(hdr);
+  char *mem = par_alloc(w, size);
+  *(size_t *)mem = hdr;
+  memcpy(mem + sizeof(size_t), obj + sizeof(size_t), size - sizeof(size_t));
+  if (!__atomic_compare_exchange_n((size_t *)obj, &hdr, (size_t)mem, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    par_unalloc(w, mem, size);
+    return hdr + tag;
+  }
+  size_t new = (size_t)mem + tag;
+  if (obj >= from_lo[0] && obj < from_hi[0]) {
+    w->promoted += size;
+  }
+  deque_push(&w->deque, new);
+  return new;
+}
+
+void par_scan(worker_t *w, size_t val) {
+  size_t *obj = (size_t *)(val & ~(size_t)7);
+  size_t first;
+  size_t last;
+  if (!obj_fields(val, &first, &last)) {
+    return;
+  }
+  for (size_t *slot = obj + first; slot < obj + last; slot++) {
+    *slot = par_forward(w, *slot);
+  }
+}
+
+/// A worker's share of a parallel copy: every n-th root, then grey objects
+/// until all workers run out of them.
+/// A worker only counts as idle while its deque is empty, and leaves that
+/// state before stealing, so all of them being idle means the copy is done.
+void par_work(worker_t *w) {
+  for (size_t i = w->id; i < par_roots; i += gc_threads) {
+    rs_begin[i] = (size_t *)par_forward(w, (size_t)rs_begin[i]);
+  }
+  for (;;) {
+    size_t val;
+    while ((val = deque_pop(&w->deque))) {
+      par_scan(w, val);
+    }
+    for (size_t i = 1; i < gc_threads && !val; i++) {
+      val = deque_steal(&workers[(w->id + i) % gc_threads].deque);
+    }
+    if (val) {
+      par_scan(w, val);
+      continue;
+    }
+    __atomic_add_fetch(&par_idle, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+      if (__atomic_load_n(&par_idle, __ATOMIC_SEQ_CST) == gc_threads) {
+        fill_gap(w->ptr, w->limit);
+        w->ptr = w->limit = 0;
+        return;
+      }
+      size_t busy = 0;
+      for (size_t i = 0; i < gc_threads && !busy; i++) {
+        busy = !deque_empty(&workers[i].deque);
       }
-      gen0_ptr = gen0_begin;
-      if (request >= gen0_size) {
-        puts("Not Enough Space on the Minor Heap to Allocate this Object! "
-             "Please "
-             "Allocate a Larger Heap.");
-        cleanup();
-        exit(1);
+      if (busy) {
+        __atomic_sub_fetch(&par_idle, 1, __ATOMIC_SEQ_CST);
+        break;
       }
+      sched_yield();
     }
   }
 }
 
-void print(size_t val) {
-  if (val == 31) { // Bool
-    printf("#f");
-  } else if (val == 159) { // Bool
-    printf("#t");
-  } else if (val == 47) { // Nil
-    printf("()");
-  } else if ((val & 0x0f) == 15) { // Char
-    printf("#\\x%zx", val >> 8);
-  } else if ((val & 7) == 1) { // Cons
-    printf("(");
-    print(*(size_t *)(val - 1));
-    while (((*(size_t *)(val + 7)) & 3) == 1) {
-      printf(" ");
-      val = *(size_t *)(val + 7);
-      print(*(size_t *)(val - 1));
-    }
-    if ((*(size_t *)(val + 7)) != 47) {
-      printf(" . ");
-      print(*(size_t *)(val + 7));
-    }
-    printf(")");
-  } else if ((val & 7) == 2) { // Vec
-    printf("#(");
-    for (size_t len = (*(size_t *)(val - 2)) >> 2, i = 0; i < len; i++) {
-      print(*(size_t *)(val + 6 + (8 * i)));
-      if (i != len - 1) {
-        printf(" ");
+/// Loop of the pooled workers, running par_work once per parallel copy
+void *worker_main(void *arg) {
+  worker_t *w = arg;
+  size_t epoch = 0;
+  for (;;) {
+    pthread_mutex_lock(&pool_lock);
+    while (pool_epoch == epoch) {
+      pthread_cond_wait(&pool_start, &pool_lock);
+    }
+    epoch = pool_epoch;
+    pthread_mutex_unlock(&pool_lock);
+    if (pool_exit) {
+      return 0;
+    }
+    par_work(w);
+    pthread_mutex_lock(&pool_lock);
+    if (!--pool_running) {
+      pthread_cond_signal(&pool_done);
+    }
+    pthread_mutex_unlock(&pool_lock);
+  }
+}
+
+/// Starts the pool of `gc_threads` - 1 workers, the collecting thread being
+/// the first one
+void init_workers() {
+  workers = calloc(gc_threads, sizeof(*workers));
+  for (size_t i = 0; i < gc_threads; i++) {
+    workers[i].id = i;
+    // A deque holds at most every object of gen1, each of 2 words at least
+    workers[i].deque.buf = reserve_space(GEN1_MAX >> 1, PROT_READ | PROT_WRITE);
+    if (i && pthread_create(&workers[i].thread, 0, worker_main, &workers[i])) {
+      perror("Failed to Start the GC Workers");
+      exit(1);
+    }
+  }
+}
+
+void stop_workers() {
+  pthread_mutex_lock(&pool_lock);
+  pool_exit = 1;
+  pool_epoch++;
+  pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_lock);
+  for (size_t i = 0; i < gc_threads; i++) {
+    if (i) {
+      pthread_join(workers[i].thread, 0);
+    }
+    munmap(workers[i].deque.buf, GEN1_MAX >> 1);
+  }
+  free(workers);
+}
+
+/// Parallel version of copy() for major collections, the remembered set
+/// being no root then
+void par_copy(size_t **rs_ptr, char **ptr, char *limit) {
+  copy_begin = *ptr;
+  copy_limit = limit;
+  par_top = *ptr;
+  par_roots = rs_ptr - rs_begin;
+  par_idle = 0;
+  for (size_t i = 0; i < gc_threads; i++) {
+    workers[i].deque.top = 0;
+    workers[i].deque.bottom = 0;
+    workers[i].promoted = 0;
+  }
+  pthread_mutex_lock(&pool_lock);
+  pool_running = gc_threads - 1;
+  pool_epoch++;
+  pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_lock);
+  par_work(&workers[0]);
+  pthread_mutex_lock(&pool_lock);
+  while (pool_running) {
+    pthread_cond_wait(&pool_done, &pool_lock);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  *ptr = par_top;
+  // Workers raced for the cards, but to-space is walkable now
+  for (char *obj = copy_begin; obj < par_top;
+       obj += hdr_size(*(size_t *)obj)) {
+    note_start(obj);
+  }
+  stats.copied += par_top - copy_begin;
+  for (size_t i = 0; i < gc_threads; i++) {
+    stats.promoted += workers[i].promoted;
+  }
+}
+
+/// Clears the forwarding table over gen1 from `begin` to `end`, if a budget
+/// reserved it
+void fwd_clear(char *begin, char *end) {
+  if (fwd_table) {
+    memset(fwd_table + (begin - card_base) / sizeof(size_t), 0, end - begin);
+  }
+}
+
+/// Replica of a gen1 object, made on first sight and scanned later on
+size_t inc_replicate(size_t val) {
+  size_t tag = val & 7;
+  char *obj = (char *)(val - tag);
+  size_t *fwd = &fwd_table[(obj - card_base) / sizeof(size_t)];
+  if (*fwd) {
+    return *fwd;
+  }
+  size_t size = obj_size(val);
+  memcpy(rep_ptr, obj, size);
+  note_start(rep_ptr);
+  fwd_clear(rep_ptr, rep_ptr + size);
+  *fwd = (size_t)rep_ptr + tag;
+  rep_ptr += size;
+  stats.replicated += size;
+  return *fwd;
+}
+
+int in_inc_from(char *obj) {
+  return obj >= gen1_begin && obj < gen1_ptr;
+}
+
+/// Makes a replica slot point to replicas. Young references, which the
+/// program only updates in the originals, are remembered for the replica as
+/// well.
+void inc_translate(size_t *slot, char **ptr) {
+  size_t val = *slot;
+  size_t tag = val & 7;
+  if (tag != 1 && tag != 2 && tag != 3 && tag != 6) {
+    return;
+  }
+  char *obj = (char *)(val - tag);
+  // Copied from an original the running minor collection had yet to update
+  if (inc_flipping && in_from(obj)) {
+    val = forward(val, ptr);
+    obj = (char *)(val - tag);
+  }
+  if (in_inc_from(obj)) {
+    val = inc_replicate(val);
+  } else if ((size_t)(obj - nursery_lo) < nursery_len) {
+    if (remset_ptr < remset_end) {
+      *remset_ptr++ = slot;
+    } else {
+      remset_full = 1;
+    }
+  }
+  *slot = val;
+}
+
+void inc_scan(size_t val, char **ptr) {
+  size_t *obj = (size_t *)(val & ~(size_t)7);
+  size_t first;
+  size_t last;
+  if (!obj_fields(val, &first, &last)) {
+    return;
+  }
+  for (size_t *slot = obj + first; slot < obj + last; slot++) {
+    inc_translate(slot, ptr);
+  }
+}
+
+/// Copies the slots the write barrier logged over to the replicas of their
+/// objects, if any yet
+void inc_replay(char **ptr) {
+  for (size_t **log = inc_log_begin; log < inc_log_ptr; log++) {
+    char *slot = (char *)*log;
+    if (!in_inc_from(slot)) {
+      continue;
+    }
+    char *obj = obj_start(slot);
+    size_t *fwd = &fwd_table[(obj - card_base) / sizeof(size_t)];
+    if (!*fwd) {
+      continue;
+    }
+    // Words, as string-set! logs the bytes it writes
+    size_t hdr = *(size_t *)obj;
+    size_t type = hdr_type(hdr);
+    size_t offset = (slot - obj) & ~(size_t)7;
+    size_t *rep = (size_t *)(*fwd - type + offset);
+    *rep = *(size_t *)(obj + offset);
+    if (type != OBJ_STR || (hdr & HDR_WIDE && offset == 2 * sizeof(size_t))) {
+      inc_translate(rep, ptr);
+    }
+  }
+  inc_log_ptr = inc_log_begin;
+}
+
+/// Replicates, or with `flip` redirects to replicas, what large objects
+/// reference in gen1. They are all taken as live until the next major.
+void inc_scan_large(int flip) {
+  for (size_t page = 0; page < los_top; page += los_pages[page]) {
+    size_t *obj = (size_t *)(los_base + page * page_size);
+    size_t first;
+    size_t last;
+    if (los_state[page] == LosFree ||
+        !obj_fields((size_t)obj, &first, &last)) {
+      continue;
+    }
+    for (size_t i = first; i < last; i++) {
+      size_t tag = obj[i] & 7;
+      if ((tag == 1 || tag == 2 || tag == 3 || tag == 6) &&
+          in_inc_from((char *)(obj[i] - tag))) {
+        size_t rep = inc_replicate(obj[i]);
+        obj[i] = flip ? rep : obj[i];
       }
     }
-    printf(")");
-  } else if ((val & 7) == 3) { // String
-    printf("\"");
-    for (size_t len = (*(size_t *)(val - 3)) >> 3, i = 0; i < len; i++) {
-      printf("%c", (char)*(size_t *)(val + 5 + i));
+  }
+}
+
+/// Replicates what the roots reference in gen1, as they keep changing and
+/// what gets promoted meanwhile is otherwise only found at the flip
+void inc_roots(size_t **rs_ptr) {
+  for (size_t i = 0; i < (size_t)(rs_ptr - rs_begin); i++) {
+    size_t tag = (size_t)rs_begin[i] & 7;
+    if ((tag == 1 || tag == 2 || tag == 3 || tag == 6) &&
+        in_inc_from((char *)rs_begin[i] - tag)) {
+      inc_replicate((size_t)rs_begin[i]);
+    }
+  }
+}
+
+/// Starts replicating gen1 into its tospace, from what the roots and large
+/// vectors reference
+void inc_start(size_t **rs_ptr) {
+  inc_active = 1;
+  rep_begin = gen1_tospace;
+  rep_ptr = gen1_tospace;
+  rep_scan = gen1_tospace;
+  inc_log_ptr = inc_log_begin;
+  memset(card_starts + ((gen1_tospace - card_base) >> CARD_SHIFT), 0,
+         gen1_size >> CARD_SHIFT);
+  inc_roots(rs_ptr);
+  inc_scan_large(0);
+}
+
+/// Scans replicas until none are left or the pause reaches `deadline`,
+/// a batch of them at least so that the cycle moves on
+void inc_slice(size_t **rs_ptr, size_t deadline) {
+  inc_replay(&gen0_ptr);
+  inc_roots(rs_ptr);
+  for (size_t n = 1; rep_scan < rep_ptr; n++) {
+    size_t hdr = *(size_t *)rep_scan;
+    inc_scan((size_t)rep_scan + hdr_type(hdr), &gen0_ptr);
+    rep_scan += hdr_size(hdr);
+    if (!(n % INC_BATCH) && now_ns() >= deadline) {
+      break;
+    }
+  }
+  stats.slices++;
+}
+
+/// Ends a cycle within the minor collection that redirected the roots and
+/// nursery to the replicas: the large objects follow, then what the
+/// collection replicated is scanned, and the replicas become gen1
+void inc_flip() {
+  inc_scan_large(1);
+  while (rep_scan < rep_ptr || scan_ptr < gen0_ptr) {
+    drain(&gen0_ptr);
+    while (rep_scan < rep_ptr) {
+      size_t hdr = *(size_t *)rep_scan;
+      inc_scan((size_t)rep_scan + hdr_type(hdr), &gen0_ptr);
+      rep_scan += hdr_size(hdr);
+    }
+  }
+  gen1_tospace = gen1_begin;
+  gen1_begin = rep_begin;
+  card_stale = gen1_ptr;
+  gen1_ptr = rep_ptr;
+  card_end = gen1_ptr;
+  // Slots of the originals are gone
+  size_t **keep = remset_begin;
+  for (size_t **slot = remset_begin; slot < remset_ptr; slot++) {
+    if ((size_t)((char *)*slot - gen1_tospace) >= gen1_size) {
+      *keep++ = *slot;
+    }
+  }
+  remset_ptr = keep;
+  clear_cards();
+  inc_active = 0;
+  inc_flipping = 0;
+  stats.cycles++;
+}
+
+/// Frees the large objects the last major collection did not mark, merging
+/// free runs with their neighbours
+void sweep_large() {
+  size_t free_run = los_top;
+  for (size_t page = 0; page < los_top; page += los_pages[page]) {
+    size_t *hdr = (size_t *)(los_base + page * page_size);
+    if (los_state[page] == LosUsed && *hdr & HDR_MARK) {
+      *hdr &= ~(size_t)HDR_MARK;
+      free_run = los_top;
+      continue;
+    }
+    if (los_state[page] == LosUsed) {
+      size_t size = los_pages[page] * page_size;
+      madvise(los_base + page * page_size, size, MADV_DONTNEED);
+      los_state[page] = LosFree;
+      los_bytes -= size;
+    }
+    if (free_run < page) {
+      los_pages[free_run] += los_pages[page];
+    } else {
+      free_run = page;
+    }
+  }
+  // A free run at the end is given back to the bump pointer
+  if (free_run < los_top) {
+    los_top = free_run;
+  }
+  los_trigger = los_bytes << 1 > LOS_TRIGGER ? los_bytes << 1 : LOS_TRIGGER;
+}
+
+void set_from(char *lo0, char *hi0, char *lo1, char *hi1) {
+  from_lo[0] = lo0;
+  from_hi[0] = hi0;
+  from_lo[1] = lo1;
+  from_hi[1] = hi1;
+}
+
+/// Copying collection
+///
+/// The nursery is first evacuated into its other half. If that does not free
+/// enough, or its survivors have already survived TENURE_AGE collections or
+/// crowd a nursery at its cap, they are promoted into gen1 instead, as are
+/// those following promoted survivors that crowded it. gen1 is itself
+/// collected together with them when it runs out of space.
+/// Instead of failing, the generations grow into their reserved space: the
+/// nursery up to `gen0_cap` when most of it survives, and past it only for a
+/// request that does not fit, and gen1 when most of it survives a major
+/// collection or a cycle runs out of room.
+/// @return How far the collection went.
+enum gc_kind gc(size_t **rs_ptr, size_t request, int major) {
+  enum gc_kind kind = Promote;
+  char *tmp;
+  card_end = gen1_ptr;
+  // A cycle that caught up flips within a minor collection
+  int flip = inc_active && rep_scan == rep_ptr;
+  if (!major && (gen0_age < TENURE_AGE || flip)) {
+    if (inc_active) {
+      // Nothing left to replicate but what the roots and nursery reference
+      inc_replay(&gen0_ptr);
+      inc_flipping = rep_scan == rep_ptr;
+    }
+    // 1. Copy all objs reachable from rs and the remembered set to tospace.
+    set_from(gen0_begin, gen0_ptr, 0, 0);
+    gen0_ptr = gen0_tospace;
+    copy(rs_ptr, &gen0_ptr, gen0_tospace + gen0_size, 1);
+    // 2. tospace = fromspace.
+    tmp = gen0_begin;
+    gen0_begin = gen0_tospace;
+    gen0_tospace = tmp;
+    if (inc_flipping) {
+      inc_flip();
+    }
+    // The remembered slots now point to the new copies, and stay old to young.
+    // Survivors that crowd the nursery grow it up to its bound, past which
+    // the next collection promotes them, as it does those that keep surviving.
+    size_t gen0_live = gen0_ptr - gen0_begin;
+    if (gen0_live > gen0_size >> 1 && gen0_size < gen0_cap) {
+      resize_gen0(grow_size(gen0_size, gen0_size << 1, gen0_cap));
+    } else if (gen0_live > gen0_size >> 1) {
+      gen0_age = TENURE_AGE;
+    } else if (gen0_live) {
+      gen0_age++;
+    }
+    if (request < (size_t)(gen0_begin + gen0_size - gen0_ptr)) {
+      return Minor;
+    }
+  }
+  gen0_age = 0;
+  size_t gen0_live = gen0_ptr - gen0_begin;
+  if (!major && inc_active &&
+      gen0_live >= (size_t)(gen1_begin + gen1_size - gen1_ptr)) {
+    // A cycle that falls behind grows both spaces rather than give up
+    size_t need = gen1_ptr - gen1_begin + gen0_live + 1;
+    resize_gen1(grow_size(gen1_size, need, GEN1_MAX));
+  }
+  if (major || gen0_live >= (size_t)(gen1_begin + gen1_size - gen1_ptr)) {
+    // Both generations into the gen1 tospace, from the roots alone, which
+    // is made large enough for all of them to survive
+    kind = Major;
+    if (inc_active) {
+      inc_active = 0;
+      stats.aborted++;
+    }
+    size_t need = (gen1_ptr - gen1_begin) + gen0_live;
+    if (gc_threads > 1) {
+      // Room for the gaps workers leave at the end of their buffers
+      need += gc_threads * TLAB_SIZE * 2;
+    }
+    resize_gen1(grow_size(gen1_size, need, GEN1_MAX));
+    set_from(gen0_begin, gen0_ptr, gen1_begin, gen1_ptr);
+    memset(card_starts + ((gen1_tospace - card_base) >> CARD_SHIFT), 0,
+           gen1_size >> CARD_SHIFT);
+    card_stale = gen1_ptr;
+    gen1_ptr = gen1_tospace;
+    los_marking = 1;
+    if (gc_threads > 1) {
+      par_copy(rs_ptr, &gen1_ptr, gen1_tospace + gen1_size);
+    } else {
+      copy(rs_ptr, &gen1_ptr, gen1_tospace + gen1_size, 0);
+    }
+    los_marking = 0;
+    sweep_large();
+    major_pending = 0;
+    tmp = gen1_begin;
+    gen1_begin = gen1_tospace;
+    gen1_tospace = tmp;
+    fwd_clear(gen1_begin, gen1_ptr);
+    size_t gen1_live = gen1_ptr - gen1_begin;
+    if (gen1_live > gen1_size >> 1) {
+      resize_gen1(grow_size(gen1_size, gen1_size << 1, GEN1_MAX));
+    }
+    // A cycle starts half full, and needs the other half to promote into
+    // while it replicates
+    if (inc_budget && gen1_live > gen1_size >> 2) {
+      resize_gen1(grow_size(gen1_size, gen1_live << 2, GEN1_MAX));
+    }
+  } else {
+    // Just copy, there is enough space
+    char *top = gen1_ptr;
+    set_from(gen0_begin, gen0_ptr, 0, 0);
+    copy(rs_ptr, &gen1_ptr, gen1_begin + gen1_size, 1);
+    // Survivors that crowd the nursery promote the next ones straight away too
+    if ((size_t)(gen1_ptr - top) > gen0_size >> 1) {
+      gen0_age = TENURE_AGE;
+    }
+    fwd_clear(top, gen1_ptr);
+    if (inc_active) {
+      // Young references of replicas are now to originals
+      size_t **end = remset_ptr;
+      for (size_t **slot = remset_begin; slot < end; slot++) {
+        if ((char *)*slot >= rep_begin && (char *)*slot < rep_ptr) {
+          inc_translate(*slot, &gen1_ptr);
+        }
+      }
+    }
+  }
+  // gen0 is empty, so no old slot points into it anymore
+  gen0_ptr = gen0_begin;
+  remset_ptr = remset_begin;
+  remset_full = 0;
+  clear_cards();
+  los_young_len = 0;
+  if (request >= gen0_size) {
+    resize_gen0(grow_size(gen0_size, request + 1, NURSERY_MAX));
+  }
+  if (request >= gen0_size) {
+    puts("Not Enough Space on the Minor Heap to Allocate this Object! "
+         "Please "
+         "Allocate a Larger Heap.");
+    cleanup(rs_last);
+    exit(1);
+  }
+  return kind;
+}
+
+size_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * (size_t)1000000000 + ts.tv_nsec;
+}
+
+/// Accounts a collection and traces it
+void record_gc(enum gc_kind kind, size_t pause, size_t copied,
+               size_t promoted) {
+  stats.count[kind]++;
+  stats.pause_total[kind] += pause;
+  stats.pause_max[kind] =
+      pause > stats.pause_max[kind] ? pause : stats.pause_max[kind];
+  size_t bucket = 0;
+  while (bucket < PAUSE_BUCKETS - 1 && pause >= (size_t)1000 << bucket) {
+    bucket++;
+  }
+  stats.pause_hist[kind][bucket]++;
+  if (trace_on) {
+    fprintf(stderr,
+            "{\"gc\":%zu,\"kind\":\"%s\",\"pause_ns\":%zu,"
+            "\"allocated\":%zu,\"copied\":%zu,\"promoted\":%zu,"
+            "\"gen0_live\":%zu,\"gen1_live\":%zu,\"large\":%zu}\n",
+            stats.count[Minor] + stats.count[Promote] + stats.count[Major],
+            gc_kind_names[kind], pause, stats.allocated, copied, promoted,
+            (size_t)(gen0_ptr - gen0_begin), (size_t)(gen1_ptr - gen1_begin),
+            los_bytes);
+  }
+}
+
+/// Whether a value references a heap object
+int is_ref(size_t val) {
+  size_t tag = val & 7;
+  return tag == OBJ_PAIR || tag == OBJ_VEC || tag == OBJ_STR ||
+         tag == OBJ_LAMB;
+}
+
+/// Writes the snapshot record of an object
+void dump_obj(FILE *file, size_t *obj) {
+  size_t first = 0;
+  size_t last = 0;
+  obj_fields((size_t)obj, &first, &last);
+  size_t rec[3] = {(size_t)obj, obj[0], 0};
+  for (size_t i = first; i < last; i++) {
+    rec[2] += is_ref(obj[i]);
+  }
+  fwrite(rec, sizeof(size_t), 3, file);
+  for (size_t i = first; i < last; i++) {
+    if (is_ref(obj[i])) {
+      size_t ref = obj[i] & ~(size_t)7;
+      fwrite(&ref, sizeof(size_t), 1, file);
+    }
+  }
+}
+
+void dump_space(FILE *file, char *begin, char *end) {
+  for (char *obj = begin; obj < end; obj += hdr_size(*(size_t *)obj)) {
+    dump_obj(file, (size_t *)obj);
+  }
+}
+
+/// Writes a snapshot of both generations and the large objects, laid out as
+/// object.h describes, with the roots below `rs_ptr`.
+/// Only called where every object below the allocation pointers is
+/// initialized, which is on entering a collection call.
+void dump_heap(size_t **rs_ptr, const char *path) {
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    perror(path);
+    return;
+  }
+  size_t head[2] = {HEAP_DUMP_MAGIC, alloc_sites_len};
+  fwrite(head, sizeof(size_t), 2, file);
+  if (alloc_sites_len) {
+    fwrite(alloc_sites, sizeof(*alloc_sites), alloc_sites_len, file);
+  }
+  size_t roots = 0;
+  for (size_t **root = rs_begin; root < rs_ptr; root++) {
+    roots += is_ref((size_t)*root);
+  }
+  fwrite(&roots, sizeof(size_t), 1, file);
+  for (size_t **root = rs_begin; root < rs_ptr; root++) {
+    if (is_ref((size_t)*root)) {
+      size_t ref = (size_t)*root & ~(size_t)7;
+      fwrite(&ref, sizeof(size_t), 1, file);
+    }
+  }
+  dump_space(file, gen0_begin, gen0_ptr);
+  dump_space(file, gen1_begin, gen1_ptr);
+  for (size_t page = 0; page < los_top; page += los_pages[page]) {
+    if (los_state[page] == LosUsed) {
+      dump_obj(file, (size_t *)(los_base + page * page_size));
+    }
+  }
+  if (fclose(file)) {
+    perror(path);
+  }
+}
+
+/// Collects when `request` bytes don't fit in gen0, or a major collection is
+/// due
+ENTRY void collect(size_t **rs_ptr, size_t request) {
+  rs_last = rs_ptr;
+  if (dump_pending) {
+    dump_pending = 0;
+    char path[64];
+    snprintf(path, sizeof(path), "ilish-%d-%zu.heap", (int)getpid(), dumps++);
+    dump_heap(rs_ptr, path);
+  }
+  int major = remset_full || major_pending;
+  if (request < (size_t)(gen0_begin + gen0_size - gen0_ptr) && !major) {
+    return;
+  }
+  gc_epoch++;
+  size_t start = now_ns();
+  size_t copied = stats.copied;
+  size_t promoted = stats.promoted;
+  stats.allocated += gen0_ptr - gen0_mark;
+  enum gc_kind kind = gc(rs_ptr, request, major);
+  if (inc_budget && kind == Promote && !inc_active &&
+      (size_t)(gen1_ptr - gen1_begin) > (gen1_size >> 3) * INC_START) {
+    inc_start(rs_ptr);
+  }
+  if (inc_active) {
+    // An eighth of the budget is left for the batch that overruns it
+    inc_slice(rs_ptr, start + inc_budget - (inc_budget >> 3));
+  }
+  gen0_mark = gen0_ptr;
+  size_t pause = now_ns() - start;
+  stats.over_budget += inc_budget && pause > inc_budget;
+  record_gc(kind, pause, stats.copied - copied, stats.promoted - promoted);
+}
+
+/// Allocates a large object in its own run of pages, reusing the first free
+/// run that fits.
+/// Forces a major collection first once large objects outgrow what the last
+/// one left.
+void *alloc_large(size_t **rs_ptr, size_t size, size_t tag) {
+  size_t pages = (size + page_size - 1) / page_size;
+  if (los_bytes + pages * page_size > los_trigger) {
+    major_pending = 1;
+    collect(rs_ptr, 0);
+  }
+  size_t page = 0;
+  while (page < los_top &&
+         (los_state[page] != LosFree || los_pages[page] < pages)) {
+    page += los_pages[page];
+  }
+  if (page < los_top) {
+    if (los_pages[page] > pages) {
+      los_pages[page + pages] = los_pages[page] - pages;
+      los_state[page + pages] = LosFree;
+    }
+  } else {
+    if ((los_top + pages) * page_size > LOS_MAX) {
+      puts("Not Enough Space on the Large Object Heap! "
+           "Please "
+           "Allocate a Smaller Object.");
+      cleanup(rs_last);
+      exit(1);
+    }
+    commit_space(los_base + los_top * page_size, pages * page_size);
+    los_top += pages;
+  }
+  los_pages[page] = pages;
+  los_state[page] = LosUsed;
+  los_bytes += pages * page_size;
+  stats.allocated += pages * page_size;
+  char *obj = los_base + page * page_size;
+  if (tag == 2) {
+    if (los_young_len == los_young_cap) {
+      los_young_cap = los_young_cap ? los_young_cap << 1 : 64;
+      los_young = realloc(los_young, los_young_cap * sizeof(*los_young));
+    }
+    los_young[los_young_len++] = (size_t)obj + tag;
+  }
+  return obj;
+}
+
+/// Allocates `size` bytes for an object of dynamic size, tagged `tag`, with
+/// large ones kept out of the copying generations
+ENTRY void *allocate(size_t **rs_ptr, size_t size, size_t tag) {
+  if (size >= LARGE_SIZE) {
+    return alloc_large(rs_ptr, size, tag);
+  }
+  collect(rs_ptr, size);
+  char *obj = gen0_ptr;
+  gen0_ptr += size;
+  return obj;
+}
+
+/// Code points of UTF-8 strings, counted as the bytes that don't continue a
+/// sequence, 10xxxxxx, which are those below -64 as signed bytes
+size_t utf8_count_scalar(const char *bytes, size_t len) {
+  size_t count = len;
+  size_t i = 0;
+  for (; i + sizeof(size_t) <= len; i += sizeof(size_t)) {
+    size_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    count -= __builtin_popcountll(word & ~(word << 1) & 0x8080808080808080);
+  }
+  for (; i < len; i++) {
+    count -= bytes[i] < -64;
+  }
+  return count;
+}
+
+/// Counts a block at a time into a counter per byte lane, summed into words
+/// every 255 blocks before the lanes can overflow
+__attribute__((target("sse2"))) size_t utf8_count_sse2(const char *bytes,
+                                                      size_t len) {
+  __m128i limit = _mm_set1_epi8(-64);
+  size_t cont = 0;
+  size_t i = 0;
+  while (i + 16 <= len) {
+    __m128i acc = _mm_setzero_si128();
+    for (size_t n = 0; n < 255 && i + 16 <= len; n++, i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i));
+      acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(limit, v));
+    }
+    __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+    cont += _mm_cvtsi128_si64(sums) +
+            _mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+  }
+  return i - cont + utf8_count_scalar(bytes + i, len - i);
+}
+
+__attribute__((target("avx2"))) size_t utf8_count_avx2(const char *bytes,
+                                                      size_t len) {
+  __m256i limit = _mm256_set1_epi8(-64);
+  size_t cont = 0;
+  size_t i = 0;
+  while (i + 32 <= len) {
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t n = 0; n < 255 && i + 32 <= len; n++, i += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(bytes + i));
+      acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(limit, v));
+    }
+    __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    cont += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+            _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+  }
+  return i - cont + utf8_count_scalar(bytes + i, len - i);
+}
+
+size_t utf8_count_pick(const char *bytes, size_t len);
+size_t (*utf8_count_fn)(const char *, size_t) = utf8_count_pick;
+
+/// Picks the widest counter the CPU supports, on the first count
+size_t utf8_count_pick(const char *bytes, size_t len) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    utf8_count_fn = utf8_count_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    utf8_count_fn = utf8_count_sse2;
+  } else {
+    utf8_count_fn = utf8_count_scalar;
+  }
+  return utf8_count_fn(bytes, len);
+}
+
+ENTRY size_t utf8_count(const char *bytes, size_t len) {
+  return utf8_count_fn(bytes, len);
+}
+
+/// Index of the first byte at which `a` and `b` differ, `len` if none does
+size_t bytes_diff_scalar(const char *a, const char *b, size_t len) {
+  size_t i = 0;
+  for (; i + sizeof(size_t) <= len; i += sizeof(size_t)) {
+    size_t x;
+    size_t y;
+    memcpy(&x, a + i, sizeof(x));
+    memcpy(&y, b + i, sizeof(y));
+    if (x != y) {
+      return i + __builtin_ctzll(x ^ y) / 8;
+    }
+  }
+  for (; i < len && a[i] == b[i]; i++) {
+  }
+  return i;
+}
+
+__attribute__((target("sse2"))) size_t bytes_diff_sse2(const char *a,
+                                                      const char *b,
+                                                      size_t len) {
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    unsigned same = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+    if (same != 0xffff) {
+      return i + __builtin_ctz(~same);
+    }
+  }
+  return i + bytes_diff_scalar(a + i, b + i, len - i);
+}
+
+__attribute__((target("avx2"))) size_t bytes_diff_avx2(const char *a,
+                                                      const char *b,
+                                                      size_t len) {
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    unsigned same = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+    if (same != 0xffffffff) {
+      return i + __builtin_ctz(~same);
+    }
+  }
+  return i + bytes_diff_scalar(a + i, b + i, len - i);
+}
+
+size_t bytes_diff_pick(const char *a, const char *b, size_t len);
+size_t (*bytes_diff_fn)(const char *, const char *,
+                        size_t) = bytes_diff_pick;
+
+/// Picks the widest comparison the CPU supports, on the first one
+size_t bytes_diff_pick(const char *a, const char *b, size_t len) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    bytes_diff_fn = bytes_diff_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    bytes_diff_fn = bytes_diff_sse2;
+  } else {
+    bytes_diff_fn = bytes_diff_scalar;
+  }
+  return bytes_diff_fn(a, b, len);
+}
+
+/// Hashes take 32 byte stripes into 4 word lanes, each adding the product of
+/// the halves of its word keyed, and the word itself. The lanes and the bytes
+/// past the last stripe are then folded with FNV-1a, so that every
+/// implementation gives the same hash.
+const size_t hash_keys[4] = {0x9e3779b97f4a7c15, 0xc2b2ae3d27d4eb4f,
+                             0x165667b19e3779f9, 0xd6e8feb86659fd93};
+
+size_t hash_finish(const size_t *lanes, const char *bytes, size_t len,
+                   size_t done) {
+  size_t hash = 0xcbf29ce484222325 ^ len;
+  for (size_t j = 0; j < 4; j++) {
+    hash = (hash ^ lanes[j]) * 0x100000001b3;
+    hash ^= hash >> 29;
+  }
+  for (size_t i = done; i < len; i++) {
+    hash = (hash ^ (unsigned char)bytes[i]) * 0x100000001b3;
+  }
+  hash ^= hash >> 32;
+  hash *= 0x9e3779b97f4a7c15;
+  return hash ^ hash >> 29;
+}
+
+size_t hash_scalar(const char *bytes, size_t len) {
+  size_t lanes[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    for (size_t j = 0; j < 4; j++) {
+      size_t word;
+      memcpy(&word, bytes + i + j * sizeof(word), sizeof(word));
+      size_t keyed = word ^ hash_keys[j];
+      lanes[j] += (keyed & 0xffffffff) * (keyed >> 32) + word;
+    }
+  }
+  return hash_finish(lanes, bytes, len, i);
+}
+
+__attribute__((target("sse2"))) size_t hash_sse2(const char *bytes,
+                                                size_t len) {
+  __m128i key_lo = _mm_loadu_si128((const __m128i *)hash_keys);
+  __m128i key_hi = _mm_loadu_si128((const __m128i *)(hash_keys + 2));
+  __m128i lo = _mm_setzero_si128();
+  __m128i hi = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i));
+    __m128i w = _mm_loadu_si128((const __m128i *)(bytes + i + 16));
+    __m128i kv = _mm_xor_si128(v, key_lo);
+    __m128i kw = _mm_xor_si128(w, key_hi);
+    lo = _mm_add_epi64(lo, _mm_mul_epu32(kv, _mm_srli_epi64(kv, 32)));
+    hi = _mm_add_epi64(hi, _mm_mul_epu32(kw, _mm_srli_epi64(kw, 32)));
+    lo = _mm_add_epi64(lo, v);
+    hi = _mm_add_epi64(hi, w);
+  }
+  size_t lanes[4];
+  _mm_storeu_si128((__m128i *)lanes, lo);
+  _mm_storeu_si128((__m128i *)(lanes + 2), hi);
+  return hash_finish(lanes, bytes, len, i);
+}
+
+__attribute__((target("avx2"))) size_t hash_avx2(const char *bytes,
+                                                size_t len) {
+  __m256i key = _mm256_loadu_si256((const __m256i *)hash_keys);
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(bytes + i));
+    __m256i kv = _mm256_xor_si256(v, key);
+    acc = _mm256_add_epi64(acc,
+                           _mm256_mul_epu32(kv, _mm256_srli_epi64(kv, 32)));
+    acc = _mm256_add_epi64(acc, v);
+  }
+  size_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  return hash_finish(lanes, bytes, len, i);
+}
+
+size_t hash_pick(const char *bytes, size_t len);
+size_t (*hash_fn)(const char *, size_t) = hash_pick;
+
+/// Picks the widest hash the CPU supports, on the first one
+size_t hash_pick(const char *bytes, size_t len) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    hash_fn = hash_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    hash_fn = hash_sse2;
+  } else {
+    hash_fn = hash_scalar;
+  }
+  return hash_fn(bytes, len);
+}
+
+size_t hash_bytes(const char *bytes, size_t len) {
+  return hash_fn(bytes, len);
+}
+
+/// Code point offsets of long UTF-8 strings, for string-ref.
+/// Strings are found by address in a direct mapped cache, whose entries a
+/// collection leaves stale as it moves them. An entry holds the byte offset
+/// of every STR_INDEX_STEP-th code point, built on the first lookup, and the
+/// last code point looked up, from which sequential access steps.
+#define STR_INDEX_STEP 64
+/// Strings with fewer bytes are walked from the start
+#define STR_INDEX_MIN 256
+#define STR_CACHE_LEN 64
+typedef struct {
+  size_t str;
+  size_t epoch;
+  size_t *offsets;
+  size_t cap;
+  size_t last_idx;
+  size_t last_off;
+} str_index_t;
+str_index_t str_cache[STR_CACHE_LEN];
+
+/// Byte offset of code point `idx` counting from the one at `off`
+size_t utf8_step(const char *bytes, size_t off, size_t idx) {
+  for (; idx; idx--) {
+    off++;
+    while (bytes[off] < -64) {
+      off++;
+    }
+  }
+  return off;
+}
+
+void build_index(str_index_t *entry, const char *bytes, size_t len,
+                 size_t count) {
+  size_t need = count / STR_INDEX_STEP + 1;
+  if (entry->cap < need) {
+    entry->cap = need;
+    entry->offsets = realloc(entry->offsets, need * sizeof(size_t));
+  }
+  size_t idx = 0;
+  for (size_t off = 0; off < len; off++) {
+    if (bytes[off] >= -64) {
+      if (!(idx % STR_INDEX_STEP)) {
+        entry->offsets[idx / STR_INDEX_STEP] = off;
+      }
+      idx++;
+    }
+  }
+}
+
+/// Finds the byte offset of code point `idx` of the string `str`
+ENTRY size_t utf8_offset(size_t str, size_t idx) {
+  const char *bytes = (const char *)(str + 13);
+  size_t len = hdr_bytes(*(size_t *)(str - 3));
+  size_t count = *(size_t *)(str + 5);
+  if (idx >= count) {
+    return len;
+  } else if (len < STR_INDEX_MIN) {
+    return utf8_step(bytes, 0, idx);
+  }
+  str_index_t *entry = str_cache + (str >> 4) % STR_CACHE_LEN;
+  if (entry->str != str || entry->epoch != gc_epoch) {
+    build_index(entry, bytes, len, count);
+    entry->str = str;
+    entry->epoch = gc_epoch;
+    entry->last_idx = 0;
+    entry->last_off = 0;
+  }
+  size_t from = idx - idx % STR_INDEX_STEP;
+  size_t off = entry->offsets[from / STR_INDEX_STEP];
+  if (entry->last_idx <= idx && entry->last_idx > from) {
+    from = entry->last_idx;
+    off = entry->last_off;
+  }
+  off = utf8_step(bytes, off, idx - from);
+  entry->last_idx = idx;
+  entry->last_off = off;
+  return off;
+}
+
+/// Drops the offsets kept for a string whose characters changed width in
+/// place
+void forget_index(size_t str) {
+  str_index_t *entry = str_cache + (str >> 4) % STR_CACHE_LEN;
+  if (entry->str == str) {
+    entry->str = 0;
+  }
+}
+
+void free_indexes() {
+  for (size_t i = 0; i < STR_CACHE_LEN; i++) {
+    free(str_cache[i].offsets);
+    str_cache[i] = (str_index_t){0};
+  }
+}
+
+/// Bytes of the UTF-8 sequence led by `lead`
+size_t utf8_width(unsigned char lead) {
+  return lead < 0x80 ? 1 : lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+}
+
+/// Code point of a character, from the UTF-8 bytes it holds
+size_t utf8_decode(size_t ch) {
+  size_t width = utf8_width(ch & 0xff);
+  if (width == 1) {
+    return ch;
+  }
+  size_t code = ch & (0x7f >> width);
+  for (size_t i = 1; i < width; i++) {
+    code = code << 6 | ((ch >> i * 8) & 0x3f);
+  }
+  return code;
+}
+
+/// Logs a slot written outside of compiled code, as its write barrier would
+void log_write(void *slot) {
+  if (!inc_active) {
+    return;
+  }
+  if (inc_log_ptr < inc_log_end) {
+    *inc_log_ptr++ = slot;
+  } else {
+    remset_full = 1;
+  }
+}
+
+/// Remembers a slot written outside of compiled code that may now reference
+/// the nursery, in either barrier mode as collections scan the remembered
+/// set in both
+void remember(size_t *slot) {
+  log_write(slot);
+  if ((size_t)((char *)*slot - nursery_lo) >= nursery_len ||
+      (size_t)((char *)slot - nursery_lo) < nursery_len) {
+    return;
+  }
+  if (remset_ptr < remset_end) {
+    *remset_ptr++ = slot;
+  } else {
+    remset_full = 1;
+  }
+}
+
+/// Decodes `count` characters of UTF-8 into cells
+void to_cells(uint32_t *cell, const char *bytes, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    size_t width = utf8_width(*bytes);
+    cell[i] = 0;
+    memcpy(cell + i, bytes, width);
+    bytes += width;
+  }
+}
+
+/// Moves the characters of a string to cells of their own, allocated below
+/// `rs_ptr`
+/// @return The string, wherever collecting for the cells moved it.
+size_t widen(size_t **rs_ptr, size_t str) {
+  size_t count = *(size_t *)(str + 5);
+  size_t words = 1 + (count + 1) / 2;
+  rs_ptr[0] = (size_t *)str;
+  size_t *cells = allocate(rs_ptr + 1, words * sizeof(size_t), OBJ_STR);
+  str = (size_t)rs_ptr[0];
+  size_t *obj = (size_t *)(str - OBJ_STR);
+  cells[0] = make_hdr(OBJ_STR, words);
+  to_cells((uint32_t *)(cells + 1), (const char *)(obj + 2), count);
+  obj[0] |= HDR_WIDE;
+  obj[2] = (size_t)cells + OBJ_STR;
+  log_write(obj);
+  remember(obj + 2);
+  return str;
+}
+
+/// string-set! for what compiled code leaves to the runtime: non ASCII
+/// strings or characters. A character of the width of the one it replaces is
+/// stored in place, otherwise the string is widened first, as shifting the
+/// bytes after it would make stores O(n).
+/// @param idx Tagged, as is `ch`.
+ENTRY void string_set(size_t **rs_ptr, size_t str, size_t idx, size_t ch) {
+  size_t *obj = (size_t *)(str - OBJ_STR);
+  idx >>= 2;
+  if (idx >= obj[1]) {
+    return;
+  }
+  uint32_t bytes = ch >> 8;
+  size_t width = utf8_width(bytes & 0xff);
+  if (!(obj[0] & HDR_WIDE)) {
+    unsigned char *at = (unsigned char *)(obj + 2);
+    at += obj[0] & HDR_UTF8 ? utf8_offset(str, idx) : idx;
+    if (utf8_width(*at) == width) {
+      memcpy(at, &bytes, width);
+      log_write(at);
+      log_write(at + width - 1);
+      return;
+    }
+    str = widen(rs_ptr, str);
+    obj = (size_t *)(str - OBJ_STR);
+    obj[0] |= width > 1 ? HDR_UTF8 : 0;
+  }
+  uint32_t *cell = (uint32_t *)(obj[2] - OBJ_STR + sizeof(size_t)) + idx;
+  *cell = bytes;
+  log_write(cell);
+}
+
+/// Cells of a wide string
+uint32_t *str_cells(size_t str) {
+  return (uint32_t *)(*(size_t *)(str + 13) - OBJ_STR + sizeof(size_t));
+}
+
+/// Offset in bytes of character `idx` of a string that isn't wide
+size_t str_offset(size_t str, size_t idx) {
+  return *(size_t *)(str - 3) & HDR_UTF8 ? utf8_offset(str, idx) : idx;
+}
+
+/// Length in bytes of characters [start, end) of a string, encoded as UTF-8
+size_t str_len(size_t str, size_t start, size_t end) {
+  if (!(*(size_t *)(str - 3) & HDR_WIDE)) {
+    return str_offset(str, end) - str_offset(str, start);
+  }
+  uint32_t *cell = str_cells(str);
+  size_t len = 0;
+  for (size_t i = start; i < end; i++) {
+    len += utf8_width(cell[i] & 0xff);
+  }
+  return len;
+}
+
+/// Copies characters [start, end) of a string to `dst` as UTF-8
+/// @return The end of the copy.
+char *str_put(char *dst, size_t str, size_t start, size_t end) {
+  if (!(*(size_t *)(str - 3) & HDR_WIDE)) {
+    size_t off = str_offset(str, start);
+    size_t len = str_offset(str, end) - off;
+    memmove(dst, (char *)(str + 13) + off, len);
+    return dst + len;
+  }
+  uint32_t *cell = str_cells(str);
+  for (size_t i = start; i < end; i++) {
+    size_t width = utf8_width(cell[i] & 0xff);
+    memcpy(dst, cell + i, width);
+    dst += width;
+  }
+  return dst;
+}
+
+/// Untags a range of characters of a string, clamped to it
+void str_range(size_t str, size_t *start, size_t *end) {
+  size_t count = *(size_t *)(str + 5);
+  *end = *end >> 2 < count ? *end >> 2 : count;
+  *start = *start >> 2 < *end ? *start >> 2 : *end;
+}
+
+/// Logs the words of `len` bytes written at `at` outside of compiled code
+void log_range(void *at, size_t len) {
+  if (!inc_active || !len) {
+    return;
+  }
+  char *end = (char *)at + len;
+  for (char *word = (char *)((size_t)at & ~(size_t)7); word < end; word += 8) {
+    log_write(word);
+  }
+}
+
+/// Allocates a string of `count` characters in `len` bytes of UTF-8, below
+/// `rs_ptr`, tagged ASCII when they are as many
+size_t *alloc_str(size_t **rs_ptr, size_t count, size_t len) {
+  size_t words = (len + 23) / sizeof(size_t);
+  size_t *obj = allocate(rs_ptr, words * sizeof(size_t), OBJ_STR);
+  obj[0] = make_hdr(OBJ_STR, words) | (-len & 7) << HDR_PAD_SHIFT |
+           (len != count ? HDR_UTF8 : 0);
+  obj[1] = count;
+  return obj;
+}
+
+/// make-string of `count` characters `ch`, for those beyond ASCII
+/// @param count Tagged.
+ENTRY size_t make_string(size_t **rs_ptr, size_t count, size_t ch) {
+  count >>= 2;
+  uint32_t bytes = ch >> 8;
+  size_t width = utf8_width(bytes & 0xff);
+  size_t *obj = alloc_str(rs_ptr, count, count * width);
+  char *dst = (char *)(obj + 2);
+  for (size_t i = 0; i < count; i++) {
+    memcpy(dst + i * width, &bytes, width);
+  }
+  return (size_t)obj + OBJ_STR;
+}
+
+/// string of the `n` characters at `chars`, on the root stack below `rs_ptr`
+/// @param n Tagged.
+ENTRY size_t string_chars(size_t **rs_ptr, size_t *chars, size_t n) {
+  n >>= 2;
+  size_t len = 0;
+  for (size_t i = 0; i < n; i++) {
+    len += utf8_width(chars[i] >> 8 & 0xff);
+  }
+  size_t *obj = alloc_str(rs_ptr, n, len);
+  char *dst = (char *)(obj + 2);
+  for (size_t i = 0; i < n; i++) {
+    uint32_t bytes = chars[i] >> 8;
+    size_t width = utf8_width(bytes & 0xff);
+    memcpy(dst, &bytes, width);
+    dst += width;
+  }
+  return (size_t)obj + OBJ_STR;
+}
+
+/// string-append of the `n` strings at `strs`, on the root stack below
+/// `rs_ptr`, in one allocation and a copy of each
+/// @param n Tagged.
+ENTRY size_t string_append(size_t **rs_ptr, size_t **strs, size_t n) {
+  n >>= 2;
+  size_t count = 0;
+  size_t len = 0;
+  for (size_t i = 0; i < n; i++) {
+    size_t str_count = *(size_t *)((size_t)strs[i] + 5);
+    count += str_count;
+    len += str_len((size_t)strs[i], 0, str_count);
+  }
+  size_t *obj = alloc_str(rs_ptr, count, len);
+  char *dst = (char *)(obj + 2);
+  for (size_t i = 0; i < n; i++) {
+    size_t str = (size_t)strs[i];
+    dst = str_put(dst, str, 0, *(size_t *)(str + 5));
+  }
+  return (size_t)obj + OBJ_STR;
+}
+
+/// substring and string-copy, of characters [start, end) of a string
+ENTRY size_t string_copy(size_t **rs_ptr, size_t str, size_t start,
+                         size_t end) {
+  str_range(str, &start, &end);
+  size_t len = str_len(str, start, end);
+  rs_ptr[0] = (size_t *)str;
+  size_t *obj = alloc_str(rs_ptr + 1, end - start, len);
+  str_put((char *)(obj + 2), (size_t)rs_ptr[0], start, end);
+  return (size_t)obj + OBJ_STR;
+}
+
+/// string-fill! of characters [start, end) of a string with `ch`, in place
+/// when their bytes are as many as the fill takes, otherwise into its cells
+ENTRY void string_fill(size_t **rs_ptr, size_t str, size_t ch, size_t start,
+                       size_t end) {
+  str_range(str, &start, &end);
+  size_t n = end - start;
+  uint32_t bytes = ch >> 8;
+  size_t width = utf8_width(bytes & 0xff);
+  size_t *obj = (size_t *)(str - OBJ_STR);
+  if (!(obj[0] & HDR_WIDE)) {
+    size_t off = str_offset(str, start);
+    char *at = (char *)(obj + 2) + off;
+    if (str_offset(str, end) - off == n * width) {
+      if (width == 1) {
+        memset(at, bytes, n);
+      } else {
+        for (size_t i = 0; i < n; i++) {
+          memcpy(at + i * width, &bytes, width);
+        }
+        forget_index(str);
+      }
+      log_range(at, n * width);
+      return;
+    }
+    str = widen(rs_ptr, str);
+    obj = (size_t *)(str - OBJ_STR);
+    obj[0] |= width > 1 ? HDR_UTF8 : 0;
+  }
+  uint32_t *cell = str_cells(str) + start;
+  for (size_t i = 0; i < n; i++) {
+    cell[i] = bytes;
+  }
+  log_range(cell, n * sizeof(uint32_t));
+}
+
+/// string-copy! of characters [start, end) of `from` into `to` at `at`, in
+/// place when the bytes they replace are as many, otherwise into its cells.
+/// Either way overlapping copies within a string move as if through a
+/// temporary.
+ENTRY void string_copy_into(size_t **rs_ptr, size_t to, size_t at,
+                            size_t from, size_t start, size_t end) {
+  str_range(from, &start, &end);
+  size_t count = *(size_t *)(to + 5);
+  at >>= 2;
+  if (at > count) {
+    return;
+  }
+  size_t n = end - start < count - at ? end - start : count - at;
+  end = start + n;
+  size_t len = str_len(from, start, end);
+  size_t *obj = (size_t *)(to - OBJ_STR);
+  if (!(obj[0] & HDR_WIDE)) {
+    size_t off = str_offset(to, at);
+    char *dst = (char *)(obj + 2) + off;
+    if (str_offset(to, at + n) - off == len) {
+      str_put(dst, from, start, end);
+      if (len != n) {
+        forget_index(to);
+      }
+      log_range(dst, len);
+      return;
+    }
+    rs_ptr[0] = (size_t *)from;
+    to = widen(rs_ptr + 1, to);
+    from = (size_t)rs_ptr[0];
+    obj = (size_t *)(to - OBJ_STR);
+    obj[0] |= len != n ? HDR_UTF8 : 0;
+  }
+  uint32_t *cell = str_cells(to) + at;
+  if (*(size_t *)(from - 3) & HDR_WIDE) {
+    memmove(cell, str_cells(from) + start, n * sizeof(uint32_t));
+  } else {
+    to_cells(cell, (char *)(from + 13) + str_offset(from, start), n);
+  }
+  log_range(cell, n * sizeof(uint32_t));
+}
+
+/// UTF-8 bytes of a string, and their length in `len`. Those of wide strings
+/// are encoded into a buffer, which str_bytes_free releases.
+char *str_bytes(size_t str, size_t *len) {
+  size_t hdr = *(size_t *)(str - 3);
+  if (!(hdr & HDR_WIDE)) {
+    *len = hdr_bytes(hdr);
+    return (char *)(str + 13);
+  }
+  size_t count = *(size_t *)(str + 5);
+  *len = str_len(str, 0, count);
+  char *bytes = malloc(*len + 1);
+  str_put(bytes, str, 0, count);
+  return bytes;
+}
+
+void str_bytes_free(size_t str, char *bytes) {
+  if (bytes != (char *)(str + 13)) {
+    free(bytes);
+  }
+}
+
+/// string=?, which compiled code calls once the strings are known to be
+/// distinct and to hold as many characters
+ENTRY size_t string_equal(size_t a, size_t b) {
+  size_t hdr_a = *(size_t *)(a - 3);
+  size_t hdr_b = *(size_t *)(b - 3);
+  if (!((hdr_a | hdr_b) & HDR_WIDE) && hdr_bytes(hdr_a) != hdr_bytes(hdr_b)) {
+    return 31; // #f
+  }
+  size_t len_a;
+  size_t len_b;
+  char *x = str_bytes(a, &len_a);
+  char *y = str_bytes(b, &len_b);
+  int same = len_a == len_b && bytes_diff_fn(x, y, len_a) == len_a;
+  str_bytes_free(a, x);
+  str_bytes_free(b, y);
+  return same ? 159 : 31;
+}
+
+/// string<?, by code points, which UTF-8 orders the same as its bytes
+ENTRY size_t string_less(size_t a, size_t b) {
+  size_t len_a;
+  size_t len_b;
+  char *x = str_bytes(a, &len_a);
+  char *y = str_bytes(b, &len_b);
+  size_t len = len_a < len_b ? len_a : len_b;
+  size_t i = bytes_diff_fn(x, y, len);
+  int less = i < len ? (unsigned char)x[i] < (unsigned char)y[i]
+                     : len_a < len_b;
+  str_bytes_free(a, x);
+  str_bytes_free(b, y);
+  return less ? 159 : 31;
+}
+
+/// string-hash, as a fixnum that isn't negative
+ENTRY size_t string_hash(size_t str) {
+  size_t len;
+  char *bytes = str_bytes(str, &len);
+  size_t hash = hash_bytes(bytes, len);
+  str_bytes_free(str, bytes);
+  return hash >> 3 << 2;
+}
+
+/// Interned symbols, open addressed by the hash of their name. Symbols are
+/// laid out like strings that are never wide, outside of the heap: those
+/// quoted in the program in its data, and those made by string->symbol with
+/// malloc. So they never move, and compare by address.
+size_t *symb_table;
+size_t symb_cap;
+size_t symb_len;
+
+/// Slot of the symbol named by `len` bytes, or the empty one it would take
+size_t *symb_slot(const char *bytes, size_t len) {
+  size_t mask = symb_cap - 1;
+  for (size_t i = hash_bytes(bytes, len) & mask;; i = (i + 1) & mask) {
+    size_t symb = symb_table[i];
+    if (!symb || (hdr_bytes(*(size_t *)(symb - OBJ_SYMB)) == len &&
+                  !memcmp((char *)(symb + 11), bytes, len))) {
+      return symb_table + i;
+    }
+  }
+}
+
+/// Adds a symbol known to be missing, growing the table past half full
+void symb_insert(size_t symb) {
+  if ((symb_len + 1) * 2 > symb_cap) {
+    size_t *old = symb_table;
+    size_t old_cap = symb_cap;
+    symb_cap = symb_cap ? symb_cap << 1 : 64;
+    symb_table = calloc(symb_cap, sizeof(size_t));
+    for (size_t i = 0; i < old_cap; i++) {
+      if (old[i]) {
+        size_t *obj = (size_t *)(old[i] - OBJ_SYMB);
+        *symb_slot((char *)(obj + 2), hdr_bytes(obj[0])) = old[i];
+      }
+    }
+    free(old);
+  }
+  size_t *obj = (size_t *)(symb - OBJ_SYMB);
+  *symb_slot((char *)(obj + 2), hdr_bytes(obj[0])) = symb;
+  symb_len++;
+}
+
+/// Interns the `len` symbols quoted in the program, which are distinct
+ENTRY void init_symbols(size_t *symbs, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    symb_insert(symbs[i]);
+  }
+}
+
+/// string->symbol, the symbol named by the characters of a string, made the
+/// first time
+ENTRY size_t string_to_symbol(size_t str) {
+  size_t count = *(size_t *)(str + 5);
+  size_t len;
+  char *bytes = str_bytes(str, &len);
+  size_t *slot = symb_cap ? symb_slot(bytes, len) : 0;
+  size_t symb = slot ? *slot : 0;
+  if (!symb) {
+    size_t words = (len + 23) / sizeof(size_t);
+    size_t *obj = calloc(words, sizeof(size_t));
+    obj[0] = make_hdr(OBJ_SYMB, words) | (-len & 7) << HDR_PAD_SHIFT |
+             (len != count ? HDR_UTF8 : 0);
+    obj[1] = count;
+    memcpy(obj + 2, bytes, len);
+    symb = (size_t)obj + OBJ_SYMB;
+    symb_insert(symb);
+  }
+  str_bytes_free(str, bytes);
+  return symb;
+}
+
+/// symbol->string, a fresh copy of the name of a symbol
+ENTRY size_t symbol_to_string(size_t **rs_ptr, size_t symb) {
+  size_t *name = (size_t *)(symb - OBJ_SYMB);
+  size_t len = hdr_bytes(name[0]);
+  size_t *obj = alloc_str(rs_ptr, name[1], len);
+  memcpy(obj + 2, name + 2, len);
+  return (size_t)obj + OBJ_STR;
+}
+
+/// Printer output, buffered and written out in large chunks
+#define OUT_LEN ((size_t)1 << 16)
+char out_buf[OUT_LEN];
+size_t out_len;
+
+void out_flush() {
+  for (size_t done = 0; done < out_len;) {
+    ssize_t n = write(STDOUT_FILENO, out_buf + done, out_len - done);
+    if (n < 0) {
+      break;
+    }
+    done += n;
+  }
+  out_len = 0;
+}
+
+void out_bytes(const char *str, size_t len) {
+  while (len) {
+    if (out_len == OUT_LEN) {
+      out_flush();
+    }
+    size_t n = OUT_LEN - out_len < len ? OUT_LEN - out_len : len;
+    memcpy(out_buf + out_len, str, n);
+    out_len += n;
+    str += n;
+    len -= n;
+  }
+}
+
+void out_str(const char *str) { out_bytes(str, strlen(str)); }
+
+/// Writes `num` in base 10 or 16, digits being produced backwards
+void out_num(size_t num, size_t base) {
+  char digits[20];
+  size_t i = sizeof(digits);
+  do {
+    digits[--i] = "0123456789abcdef"[num % base];
+    num /= base;
+  } while (num);
+  out_bytes(digits + i, sizeof(digits) - i);
+}
+
+/// What is left to print, kept on an explicit stack so that deep structures
+/// don't overflow the C one.
+/// A value, what follows the car of a pair, the rest of a vector from
+/// element `i`, or the parenthesis closing a dotted pair.
+enum print_kind { PrintVal, PrintTail, PrintVec, PrintClose };
+typedef struct {
+  enum print_kind kind;
+  size_t val;
+  size_t i;
+} print_item_t;
+print_item_t *print_stack;
+size_t print_len;
+size_t print_cap;
+
+void print_push(enum print_kind kind, size_t val, size_t i) {
+  if (print_len == print_cap) {
+    print_cap = print_cap ? print_cap << 1 : 256;
+    print_stack = realloc(print_stack, print_cap * sizeof(*print_stack));
+  }
+  print_stack[print_len++] = (print_item_t){kind, val, i};
+}
+
+/// Prints a value, without descending into pairs and vectors, which are
+/// pushed instead
+void print_val(size_t val) {
+  if (val == 31) { // Bool
+    out_str("#f");
+  } else if (val == 159) { // Bool
+    out_str("#t");
+  } else if (val == 47) { // Nil
+    out_str("()");
+  } else if ((val & 0x0f) == 15) { // Char
+    out_str("#\\x");
+    out_num(utf8_decode(val >> 8), 16);
+  } else if ((val & 7) == 1) { // Cons
+    out_str("(");
+    print_push(PrintTail, val, 0);
+    print_push(PrintVal, *(size_t *)(val + 7), 0);
+  } else if ((val & 7) == 2) { // Vec
+    out_str("#(");
+    print_push(PrintVec, val, 0);
+  } else if ((val & 7) == 3) { // String
+    size_t *obj = (size_t *)(val - 3);
+    out_str("\"");
+    if (obj[0] & HDR_WIDE) {
+      uint32_t *cell = (uint32_t *)(obj[2] - 3 + sizeof(size_t));
+      for (size_t i = 0; i < obj[1]; i++) {
+        out_bytes((char *)(cell + i), utf8_width(cell[i] & 0xff));
+      }
+    } else {
+      out_bytes((char *)(val + 13), hdr_bytes(obj[0]));
+    }
+    out_str("\"");
+  } else if ((val & 7) == 5) { // Symbol
+    out_bytes((char *)(val + 11), hdr_bytes(*(size_t *)(val - 5)));
+  } else if ((val & 7) == 6) { // Lambda
+    out_str("<Lambda>(ref=0x");
+    out_num(val + 2, 16);
+    out_str(", arity=");
+    out_num(hdr_arity(*(size_t *)(val - 6)), 10);
+    out_str(")");
+  } else if (!(val & 3)) { // Fixnum
+    if ((ssize_t)val < 0) {
+      out_str("-");
+      val = -val;
+    }
+    out_num(val >> 2, 10);
+  }
+}
+
+ENTRY void print(size_t val) {
+  print_len = 0;
+  print_push(PrintVal, val, 0);
+  while (print_len) {
+    print_item_t item = print_stack[--print_len];
+    switch (item.kind) {
+    case PrintVal:
+      print_val(item.val);
+      break;
+    case PrintTail: {
+      size_t cdr = *(size_t *)(item.val + 15);
+      if ((cdr & 7) == 1) {
+        out_str(" ");
+        print_push(PrintTail, cdr, 0);
+        print_push(PrintVal, *(size_t *)(cdr + 7), 0);
+      } else if (cdr != 47) {
+        out_str(" . ");
+        print_push(PrintClose, 0, 0);
+        print_push(PrintVal, cdr, 0);
+      } else {
+        out_str(")");
+      }
+      break;
+    }
+    case PrintVec: {
+      size_t len = hdr_words(*(size_t *)(item.val - 2)) - 1;
+      if (item.i == len) {
+        out_str(")");
+        break;
+      }
+      if (item.i) {
+        out_str(" ");
+      }
+      print_push(PrintVec, item.val, item.i + 1);
+      print_push(PrintVal, *(size_t *)(item.val + 6 + 8 * item.i), 0);
+      break;
+    }
+    case PrintClose:
+      out_str(")");
+      break;
     }
-    printf("\"");
-  } else if ((val & 7) == 6) { // Lambda
-    printf("<Lambda>(ref=0x%zx, arity=%zu)", val + 2, *((size_t *)(val - 6)));
-  } else if (!(val & 3)) { // Fixnum
-    printf("%zd", ((ssize_t)val >> 2));
   }
+  out_flush();
 }
@@ -1,14 +1,17 @@
 #include "bitmat.h"
 #include <stdlib.h>
+#include <string.h>
+
+#define WORD_BITS (sizeof(size_t) * 8)
 
-/// NOTE: Currently a simple implementation which is a bit memory wasteful
-/// and only supports up to 64 columns
-/// This is not a problem given that for argument ordering,
-/// it is unlikely to use 64 of them, but preferably limit is significantly
-/// increased.
 bitmat_t *create_bitmat(size_t nrow, size_t ncol) {
   bitmat_t *bitmat = malloc(sizeof(*bitmat));
-  bitmat->arr = calloc(sizeof(*bitmat->arr), nrow);
+  bitmat->stride = (ncol + WORD_BITS - 1) / WORD_BITS;
+  if (!bitmat->stride) {
+    bitmat->stride = 1;
+  }
+  bitmat->arr =
+      calloc(bitmat->stride * (nrow ? nrow : 1), sizeof(*bitmat->arr));
   bitmat->nrow = nrow;
   bitmat->ncol = ncol;
   return bitmat;
@@ -19,39 +22,35 @@ void delete_bitmat(bitmat_t *bitmat) {
   free(bitmat);
 }
 
+static inline size_t *row_bitmat(bitmat_t *bitmat, size_t row) {
+  return bitmat->arr + row * bitmat->stride;
+}
+
 int get_bitmat(bitmat_t *bitmat, size_t row, size_t col) {
-  return bitmat->arr[row] & (1 << col);
+  return (row_bitmat(bitmat, row)[col / WORD_BITS] >> (col % WORD_BITS)) & 1;
 }
 
 void set_bitmat(bitmat_t *bitmat, size_t row, size_t col, int val) {
-  bitmat->arr[row] |= val << col;
+  size_t *word = &row_bitmat(bitmat, row)[col / WORD_BITS];
+  size_t bit = (size_t)1 << (col % WORD_BITS);
+  *word = val ? *word | bit : *word & ~bit;
 }
 
 void flip_bitmat(bitmat_t *bitmat, size_t row, size_t col) {
-  bitmat->arr[row] ^= 1 << col;
+  row_bitmat(bitmat, row)[col / WORD_BITS] ^= (size_t)1 << (col % WORD_BITS);
 }
 
-size_t is_ef_pivot_col_bitmat(bitmat_t *bitmat, size_t pivot_col, size_t row) {
-  for (size_t i = row + 1; i < bitmat->nrow; i++) {
-    if (get_bitmat(bitmat, i, pivot_col)) {
-      return i;
-    }
-  }
-  return 0;
+void clear_row_bitmat(bitmat_t *bitmat, size_t row) {
+  memset(row_bitmat(bitmat, row), 0, sizeof(*bitmat->arr) * bitmat->stride);
 }
 
-size_t is_row_unique_bitmat(bitmat_t *bitmat, size_t pivot_row) {
-  for (size_t j = pivot_row; j < bitmat->nrow; j++) {
-    if (!(bitmat->arr[pivot_row] ^ bitmat->arr[j]) &&
-        !(bitmat->arr[pivot_row] != ((size_t)1 << pivot_row))) {
-      return j;
+ssize_t find_col_bitmat(bitmat_t *bitmat, size_t col) {
+  size_t w = col / WORD_BITS;
+  size_t bit = (size_t)1 << (col % WORD_BITS);
+  for (size_t i = 0; i < bitmat->nrow; i++) {
+    if (row_bitmat(bitmat, i)[w] & bit) {
+      return i;
     }
   }
-  return 0;
-}
-
-void swap_row_bitmat(bitmat_t *bitmat, size_t r1, size_t r2) {
-  size_t tmp = bitmat->arr[r1];
-  bitmat->arr[r1] = bitmat->arr[r2];
-  bitmat->arr[r2] = tmp;
+  return -1;
 }
@@ -7,14 +7,13 @@
 /// @brief Bitmatrix
 
 /// @brief The Bitmatrix
-/// TODO: Make ncol scalable beyond 64bit limit of a single size_t.
-/// Arrays of arrays are an option.
-/// Best to redesign it into even more compact form.
-/// I.e. 8x8 being a single integer.
+///
+/// Each row is `stride` 64bit words, enough for every column.
 typedef struct bitmat_t {
-  size_t *arr; ///> The pointer to numbers
-  size_t nrow; ///> The number of rows/numbers of the matrix
-  size_t ncol; ///> The number of columns of the matrix
+  size_t *arr;   ///> The pointer to words, row after row
+  size_t nrow;   ///> The number of rows of the matrix
+  size_t ncol;   ///> The number of columns of the matrix
+  size_t stride; ///> The number of words per row
 } bitmat_t;
 
 /// @brief Create the `bitmat` object with initial capacity.
@@ -28,43 +27,16 @@ void delete_bitmat(bitmat_t *mat);
 
 int get_bitmat(bitmat_t *bitmat, size_t row, size_t col);
 
+/// @brief Sets a bit to 1 if `val` is nonzero, 0 otherwise
 void set_bitmat(bitmat_t *bitmat, size_t row, size_t col, int val);
 
 void flip_bitmat(bitmat_t *bitmat, size_t row, size_t col);
 
-/// @brief Checks if column pivot is in echelon form,
-///
-/// I.e. everything below it is 0.
-/// Do note that for my graph ordering purposes only diagonals need to be
-/// checked.
-///    a b
-/// [a 1 0
-/// a 1 0].
-/// So despite this not being an echelon form, this can be
-/// "echelon form" from perspective of diagonals (like top a going into b).
-/// @returns 0 if yes, >0 indicates no and represents the issue row
-size_t is_ef_pivot_col_bitmat(bitmat_t *bitmat, size_t pivot_col, size_t row);
-
-/// @brief Checks if there is a duplicate for a given row,
-///
-/// I.e. unsolvable ordering conflicts.
-///      a b
-/// [a+b 1 1
-/// ab  1 1].
-/// This is impossible to solve since a or b will have to be
-/// overwritten before they are used.
-/// While
-/// [1 1
-/// 0 1] has a clear solution.
-/// This also accounts for a special case
-/// [1 0
-/// 1 0].
-/// Where theory dictates it is a duplicate, for ordering purposes only
-/// diagonals matter, so there is not.
-/// @returns 0 if yes, >0 there is a duplicate and represents the issue row
-size_t is_row_unique_bitmat(bitmat_t *bitmat, size_t pivot_row);
+/// @brief Zeroes a row
+void clear_row_bitmat(bitmat_t *bitmat, size_t row);
 
-/// @brief Swaps two rows
-void swap_row_bitmat(bitmat_t *bitmat, size_t r1, size_t r2);
+/// @brief Finds the first row with the column set
+/// @returns Index of the row, -1 if the column is all 0
+ssize_t find_col_bitmat(bitmat_t *bitmat, size_t col);
 
 #endif // BITMAT_H
@@ -6,7 +6,9 @@
 #include "expr.h"
 #include "exprs.h"
 #include "strs.h"
+#include "../runtime/object.h"
 #include <err.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,11 +35,28 @@ compiler_t *create_compiler() {
   compiler->loc = 0;
   compiler->heap = 0;
   compiler->heap_size = 0;
+  compiler->barrier = Remset;
+  compiler->profile = 0;
+  compiler->sites = 0;
   compiler->label = 0;
   compiler->lambda = 0;
   compiler->free = 0;
   compiler->ret_type = None;
   compiler->ret_args = 0;
+  compiler->spills = malloc(sizeof(*compiler->spills) * 8);
+  compiler->spill_len = 0;
+  compiler->spill_cap = 8;
+  compiler->spill_slots = 0;
+  compiler->spill_max = 0;
+  compiler->frame = 0;
+  compiler->later = malloc(sizeof(*compiler->later) * 8);
+  compiler->later_len = 0;
+  compiler->later_cap = 8;
+  compiler->later_base = 0;
+  compiler->later_vars = 0;
+  compiler->doing = malloc(sizeof(*compiler->doing) * 8);
+  compiler->doing_len = 0;
+  compiler->doing_cap = 8;
   compiler->env = create_env(8, 3, 3, 0, 2);
   compiler->bss = create_strs(2);
   push_strs(compiler->bss, strdup(".bss"));
@@ -47,6 +66,7 @@ compiler_t *create_compiler() {
   push_dstrs(compiler->fun, strdup(".text\n.global main"));
   compiler->main = create_strs(6);
   compiler->quotes = create_strs(2);
+  compiler->symbs = create_strs(2);
   compiler->body = create_strs(8);
   compiler->end = create_strs(2);
   compiler->emit = Body;
@@ -70,12 +90,17 @@ void delete_compiler(compiler_t *compiler) {
     delete_strs(compiler->body);
   if (compiler->quotes)
     delete_strs(compiler->quotes);
+  if (compiler->symbs)
+    delete_strs(compiler->symbs);
   if (compiler->main)
     delete_strs(compiler->main);
   if (compiler->end)
     delete_strs(compiler->end);
   if (compiler->errs)
     delete_errs(compiler->errs);
+  free(compiler->spills);
+  free(compiler->later);
+  free(compiler->doing);
   free(compiler);
 }
 
@@ -89,14 +114,35 @@ void try_emit_tail_call(compiler_t *compiler, const char *name, exprs_t args,
                         expr_t last);
 /// GC collect call
 void collect(compiler_t *compiler, size_t request);
-/// GC collect call from return register + extra
-void collect_retq(compiler_t *compiler, size_t extra);
-/// GC collect call from return register + extra for bytes like strings
-void collect_retb(compiler_t *compiler, size_t extra);
-/// Spill function arguments into stack to preserve them
-size_t spill_args(compiler_t *compiler);
-/// Restore spilled into stack arguments
-void reorganize_args(compiler_t *compiler, size_t count);
+/// GC allocate call for the byte size in the return register, which leaves
+/// the uninitialized object in r14
+void alloc_ret(compiler_t *compiler, size_t tag);
+/// Count an allocation of `bytes` at the current line when profiling, or of
+/// the byte size in the return register if 0
+/// @return The site to record in the header, 0 if none.
+size_t count_alloc(compiler_t *compiler, size_t type, size_t bytes);
+/// Spill live caller saved registers into the frame to preserve them
+size_t spill_args(compiler_t *compiler, size_t arity);
+/// Call a runtime function that may collect, with the root stack pointer and
+/// then the values of `len` variables, returning in %rax
+void emit_collecting_call(compiler_t *compiler, const char *fun, size_t *vars,
+                          size_t len);
+/// Spill every live pointer register onto the root stack, for a call that may
+/// collect
+size_t spill_pointers(compiler_t *compiler);
+/// Reload the pointers spilled onto the root stack, wherever the collector
+/// moved them
+void reorganize_pointers(compiler_t *compiler, size_t count);
+/// Spill the closure register into the frame to preserve it
+size_t spill_closure(compiler_t *compiler);
+/// Restore spilled into the frame registers
+void reorganize_args(compiler_t *compiler, size_t base);
+/// Push code that runs after the current expression, for liveness
+void push_later(compiler_t *compiler, exprs_t exprs);
+/// Pop what push_later pushed last
+void pop_later(compiler_t *compiler);
+/// Push the operands of a form as being emitted, for liveness
+void push_doing(compiler_t *compiler, expr_t *operands);
 
 int has_errc(compiler_t *compiler) { return compiler->errs->len; }
 
@@ -133,7 +179,17 @@ void emit(compiler_t *compiler, char *phrase) {
 
 ssize_t tag_fixnum(ssize_t num) { return num << 2; }
 size_t tag_char(size_t ch) { return (ch << 8) | 0x0f; }
-size_t tag_unichar(size_t uch) { return (uch << 8) | 0x0f; }
+/// Characters beyond ASCII hold their UTF-8 bytes, first byte lowest, as
+/// string-ref reads them out of strings
+size_t tag_unichar(size_t uch) {
+  size_t width = uch < 0x800 ? 2 : uch < 0x10000 ? 3 : 4;
+  size_t bytes = (0xf00 >> width) & 0xff;
+  bytes |= uch >> (width - 1) * 6;
+  for (size_t i = 1; i < width; i++) {
+    bytes |= (0x80 | ((uch >> (width - 1 - i) * 6) & 0x3f)) << i * 8;
+  }
+  return (bytes << 8) | 0x0f;
+}
 size_t tag_bool(size_t bool) { return (bool << 7) | 0x1f; }
 size_t tag_nil() { return 0x2f; }
 
@@ -416,8 +472,8 @@ void emit_genins_reg_regmem(compiler_t *compiler, const char *ins,
 
 void emit_genins_regmem_regmem(compiler_t *compiler, const char *ins,
                                const char *movins,
-                               const char *(*regf)(enum reg), size_t add1,
-                               enum reg mem_reg1, size_t add2,
+                               const char *(*regf)(enum reg), ssize_t add1,
+                               enum reg mem_reg1, ssize_t add2,
                                enum reg mem_reg2) {
   size_t tmp =
       get_unused_pren_env(compiler->env, compiler->env->reserved_offset);
@@ -427,22 +483,22 @@ void emit_genins_regmem_regmem(compiler_t *compiler, const char *ins,
     emit_genins_reg_reg(compiler, movins, regf, (tmp >> 1) + 1, new + 1);
   }
   if (add1 && add2) {
-    emit_mal_sprintf("%s %zu(%s) %s\n%s %s, %zu(%s)",
+    emit_mal_sprintf("%s %zd(%s), %s\n%s %s, %zd(%s)",
                      args(movins, add1, reg_to_str(mem_reg1),
                           regf((tmp >> 1) + 1), ins, regf((tmp >> 1) + 1), add2,
                           reg_to_str(mem_reg2)));
   } else if (add1) {
-    emit_mal_sprintf("%s %zu(%s) %s\n%s %s, (%s)",
+    emit_mal_sprintf("%s %zd(%s), %s\n%s %s, (%s)",
                      args(movins, add1, reg_to_str(mem_reg1),
                           regf((tmp >> 1) + 1), ins, regf((tmp >> 1) + 1),
                           reg_to_str(mem_reg2)));
   } else if (add2) {
-    emit_mal_sprintf("%s (%s) %s\n%s %s, %zu(%s)",
+    emit_mal_sprintf("%s (%s), %s\n%s %s, %zd(%s)",
                      args(movins, reg_to_str(mem_reg1), regf((tmp >> 1) + 1),
                           ins, regf((tmp >> 1) + 1), add2,
                           reg_to_str(mem_reg2)));
   } else {
-    emit_mal_sprintf("%s (%s) %s\n%s %s, (%s)",
+    emit_mal_sprintf("%s (%s), %s\n%s %s, (%s)",
                      args(movins, reg_to_str(mem_reg1), regf((tmp >> 1) + 1),
                           ins, regf((tmp >> 1) + 1), reg_to_str(mem_reg2)));
   }
@@ -724,6 +780,13 @@ void emit_movq_imm_regmem(compiler_t *compiler, ssize_t imm, ssize_t add,
 }
 
 void emit_movq_imm_var(compiler_t *compiler, ssize_t imm, size_t var) {
+  // Only registers take 64 bit immediates, like those of 4 byte characters
+  if (var >= compiler->env->stack_offset &&
+      (imm < INT32_MIN || imm > INT32_MAX)) {
+    emit_movq_imm_reg(compiler, imm, R14);
+    emit_movq_reg_var(compiler, R14, var);
+    return;
+  }
   emit_genins_imm_var(compiler, "movq", reg_to_str, imm, var);
 }
 
@@ -959,13 +1022,31 @@ void emit_unary(compiler_t *compiler, const char *action, exprs_t args) {
 void emit_begin(compiler_t *compiler, exprs_t args) {
   if (args.len) {
     for (size_t i = 0; i < args.len; i++) {
+      push_later(compiler, slice_start_exprs(&args, i + 1));
       emit_expr(compiler, args.arr[i]);
+      pop_later(compiler);
     }
   } else {
     errc(compiler, ExpectedAtLeastUnary);
   }
 }
 
+/// Stores a later operand of an n-ary operation at `index`.
+///
+/// Operands that are not atoms are computed in rax, which holds what has been
+/// accumulated so far, so it is kept in another register meanwhile.
+void emit_store_operand(compiler_t *compiler, expr_t expr, size_t index) {
+  if (expr.type == List || expr.type == Vec || expr.type == Str) {
+    size_t acc = get_unused_env(compiler->env);
+    emit_movq_reg_var(compiler, Rax, acc);
+    emit_store_expr(compiler, expr, index, 0, 0);
+    emit_movq_var_reg(compiler, acc, Rax);
+    remove_env(compiler->env, acc);
+  } else {
+    emit_store_expr(compiler, expr, index, 0, 0);
+  }
+}
+
 /// Binary with support for variable number of arguments
 void emit_binary(compiler_t *compiler, const char *action, exprs_t args) {
   if (args.len >= 2) {
@@ -974,7 +1055,7 @@ void emit_binary(compiler_t *compiler, const char *action, exprs_t args) {
     emit_expr(compiler, args.arr[0]);
     emit_var_str(compiler, action, arg1);
     for (size_t i = 2; i < args.len; i++) {
-      emit_store_expr(compiler, args.arr[i], arg1, 0, 0);
+      emit_store_operand(compiler, args.arr[i], arg1);
       emit_var_str(compiler, action, arg1);
     }
     remove_env(compiler->env, arg1);
@@ -996,26 +1077,282 @@ void emit_comp(compiler_t *compiler, const char *action, exprs_t args) {
   }
 }
 
+/// Largest constant (in magnitude) that is strength reduced, this keeps every
+/// derived bias and mask inside a sign extended 32 bit immediate.
+#define STRENGTH_LIMIT ((ssize_t)1 << 28)
+
+/// Returns k for num = 2^k, -1 otherwise
+int log2_pow2(size_t num) {
+  if (!num || (num & (num - 1))) {
+    return -1;
+  }
+  return __builtin_ctzll(num);
+}
+
+/// Magic multiplier and shift for signed division by a constant.
+/// Taken from Hacker's Delight (10-1), where d must not be -1, 0 or 1.
+void calc_magic(ssize_t d, ssize_t *magic, size_t *shift) {
+  const size_t two63 = (size_t)1 << 63;
+  size_t ad = d < 0 ? -(size_t)d : (size_t)d;
+  size_t t = two63 + ((size_t)d >> 63);
+  size_t anc = t - 1 - t % ad;
+  size_t p = 63;
+  size_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+  size_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+  size_t delta;
+  do {
+    p++;
+    q1 <<= 1;
+    r1 <<= 1;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 <<= 1;
+    r2 <<= 1;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  *magic = d < 0 ? -(ssize_t)(q2 + 1) : (ssize_t)(q2 + 1);
+  *shift = p - 64;
+}
+
+/// Whether `*`, `/` or `modulo` can use the constant as an immediate
+int is_strength_num(expr_t expr) {
+  return expr.type == Num && expr.num > -STRENGTH_LIMIT &&
+         expr.num < STRENGTH_LIMIT;
+}
+
+/// Multiply tagged rax by an untagged constant.
+/// Since 4a * c = 4(ac), the result is already tagged.
+void emit_mul_imm(compiler_t *compiler, ssize_t num) {
+  size_t abs = num < 0 ? -(size_t)num : (size_t)num;
+  int k = log2_pow2(abs);
+  if (!num) {
+    emit_str(compiler, "xorl %eax, %eax");
+    return;
+  } else if (k >= 0) {
+    if (k) {
+      emit_shlq_imm_reg(compiler, k, Rax);
+    }
+  } else if (!(abs % 3) && log2_pow2(abs / 3) >= 0) {
+    emit_str(compiler, "leaq (%rax,%rax,2), %rax");
+    if (abs / 3 > 1) {
+      emit_shlq_imm_reg(compiler, log2_pow2(abs / 3), Rax);
+    }
+  } else if (!(abs % 5) && log2_pow2(abs / 5) >= 0) {
+    emit_str(compiler, "leaq (%rax,%rax,4), %rax");
+    if (abs / 5 > 1) {
+      emit_shlq_imm_reg(compiler, log2_pow2(abs / 5), Rax);
+    }
+  } else if (!(abs % 9) && log2_pow2(abs / 9) >= 0) {
+    emit_str(compiler, "leaq (%rax,%rax,8), %rax");
+    if (abs / 9 > 1) {
+      emit_shlq_imm_reg(compiler, log2_pow2(abs / 9), Rax);
+    }
+  } else {
+    emit_size_str(compiler, "imulq $%zd, %%rax, %%rax", num);
+    return;
+  }
+  if (num < 0) {
+    emit_str(compiler, "negq %rax");
+  }
+}
+
+/// Truncated quotient of tagged rax by an untagged constant, left in rdx
+/// untagged. Dividing 4a by 4c gives a/c, so no untagging is needed.
+/// The dividend is preserved in `n`.
+void emit_magic_div(compiler_t *compiler, ssize_t num, size_t n) {
+  ssize_t magic;
+  size_t shift;
+  calc_magic(num * 4, &magic, &shift);
+  emit_movq_reg_var(compiler, Rax, n);
+  emit_size_str(compiler, "movabsq $%zd, %%rdx", magic);
+  emit_str(compiler, "imulq %rdx");
+  if (num > 0 && magic < 0) {
+    emit_var_str(compiler, "addq %s, %%rdx", n);
+  } else if (num < 0 && magic > 0) {
+    emit_var_str(compiler, "subq %s, %%rdx", n);
+  }
+  if (shift) {
+    emit_size_str(compiler, "sarq $%zu, %%rdx", shift);
+  }
+  emit_str(compiler, "movq %rdx, %rax\nshrq $63, %rax\naddq %rax, %rdx");
+}
+
+/// Reserves rdx for the magic division and idivq.
+///
+/// Whatever occupied rdx is moved to another register, and the variables
+/// mapped to rdx are re-pointed there, so operands read after rdx has been
+/// overwritten still see their value.
+/// @return Index of the register now holding it, or -1 if rdx was free.
+ssize_t reserve_rdx(compiler_t *compiler) {
+  while (compiler->env->rlen <= 2) {
+    push_env(compiler->env, None, 0);
+  }
+  if (compiler->env->rarr[2].type) {
+    size_t tmp = reassign_postn_env(compiler->env, 2, 0);
+    emit_movq_reg_var(compiler, Rdx, tmp);
+    compiler->env->rarr[2].type = Unknown;
+    return tmp;
+  }
+  compiler->env->rarr[2].type = Unknown;
+  return -1;
+}
+
+/// Gives rdx back to what reserve_rdx moved out of it
+void restore_rdx(compiler_t *compiler, ssize_t saved) {
+  remove_env(compiler->env, 2);
+  if (saved != -1) {
+    emit_movq_var_reg(compiler, saved, Rdx);
+    reassign_postn_env(compiler->env, saved, 2);
+  }
+}
+
+/// Divide tagged rax by an untagged constant, rounding towards 0 like idivq.
+/// Expects rdx to be reserved.
+void emit_div_imm(compiler_t *compiler, ssize_t num) {
+  size_t abs = num < 0 ? -(size_t)num : (size_t)num;
+  int k = log2_pow2(abs);
+  if (abs == 1) {
+    if (num < 0) {
+      emit_str(compiler, "negq %rax");
+    }
+  } else if (k > 0) {
+    // Bias negative dividends so the shift rounds towards 0, clearing the
+    // bits shifted into the tag afterwards
+    emit_size_str(compiler, "leaq %zu(%%rax), %%rdx", (4 << k) - 4);
+    emit_str(compiler, "testq %rax, %rax\ncmovsq %rdx, %rax");
+    emit_size_str(compiler, "sarq $%zu, %%rax\nandq $-4, %%rax", k);
+    if (num < 0) {
+      emit_str(compiler, "negq %rax");
+    }
+  } else {
+    size_t n = get_unused_env(compiler->env);
+    emit_magic_div(compiler, num, n);
+    emit_str(compiler, "leaq (,%rdx,4), %rax");
+    remove_env(compiler->env, n);
+  }
+}
+
+/// Remainder of tagged rax by an untagged constant, with the sign of the
+/// dividend like idivq. Expects rdx to be reserved.
+void emit_mod_imm(compiler_t *compiler, ssize_t num) {
+  size_t abs = num < 0 ? -(size_t)num : (size_t)num;
+  int k = log2_pow2(abs);
+  if (abs == 1) {
+    emit_str(compiler, "xorl %eax, %eax");
+  } else if (k > 0) {
+    // x - trunc(x / 2^k) * 2^k, where the product is just a mask
+    emit_size_str(compiler, "leaq %zu(%%rax), %%rdx", (4 << k) - 4);
+    emit_str(compiler, "testq %rax, %rax\ncmovnsq %rax, %rdx");
+    emit_size_str(compiler, "andq $%zd, %%rdx", -((ssize_t)4 << k));
+    emit_str(compiler, "subq %rdx, %rax");
+  } else {
+    size_t n = get_unused_env(compiler->env);
+    emit_magic_div(compiler, num, n);
+    emit_size_str(compiler, "imulq $%zd, %%rdx, %%rdx", num * 4);
+    emit_movq_var_reg(compiler, n, Rax);
+    emit_str(compiler, "subq %rdx, %rax");
+    remove_env(compiler->env, n);
+  }
+}
+
+/// Specialized emit_binary for multiplication
+///
+/// All constant operands are folded into a single factor, which is then
+/// strength reduced instead of going through untag and imulq.
+void emit_mul(compiler_t *compiler, exprs_t args) {
+  if (args.len >= 2) {
+    // Constants are folded as long as their product doesn't overflow, the
+    // others are multiplied at runtime
+    ssize_t factor = 1;
+    size_t first = args.len;
+    char *folded = calloc(args.len, sizeof(*folded));
+    for (size_t i = 0; i < args.len; i++) {
+      ssize_t product;
+      if (args.arr[i].type == Num &&
+          !__builtin_mul_overflow(factor, args.arr[i].num, &product)) {
+        factor = product;
+        folded[i] = 1;
+      } else if (first == args.len) {
+        first = i;
+      }
+    }
+    if (first == args.len) {
+      free(folded);
+      emit_movq_imm_reg(compiler, tag_fixnum(factor), Rax);
+      return;
+    }
+    emit_expr(compiler, args.arr[first]);
+    size_t arg1 = get_unused_env(compiler->env);
+    for (size_t i = first + 1; i < args.len; i++) {
+      if (!folded[i]) {
+        emit_store_operand(compiler, args.arr[i], arg1);
+        emit_var_str(compiler, "sarq $2, %%rax\nimulq %s, %%rax", arg1);
+      }
+    }
+    if (factor > -STRENGTH_LIMIT && factor < STRENGTH_LIMIT) {
+      emit_mul_imm(compiler, factor);
+    } else {
+      emit_movq_imm_var(compiler, factor, arg1);
+      emit_var_str(compiler, "imulq %s, %%rax", arg1);
+    }
+    remove_env(compiler->env, arg1);
+    free(folded);
+  } else {
+    errc(compiler, ExpectedBinary);
+  }
+}
+
+/// Specialized emit_binary for division
+///
+/// Constant divisors avoid idivq, see emit_div_imm.
+void emit_div(compiler_t *compiler, exprs_t args) {
+  if (args.len >= 2) {
+    ssize_t saved = reserve_rdx(compiler);
+    size_t arg1 = get_unused_env(compiler->env);
+    if (!is_strength_num(args.arr[1]) || !args.arr[1].num) {
+      emit_store_expr(compiler, args.arr[1], arg1, 0, 0);
+    }
+    emit_expr(compiler, args.arr[0]);
+    for (size_t i = 1; i < args.len; i++) {
+      if (is_strength_num(args.arr[i]) && args.arr[i].num) {
+        emit_div_imm(compiler, args.arr[i].num);
+        continue;
+      }
+      if (i > 1) {
+        emit_store_operand(compiler, args.arr[i], arg1);
+      }
+      emit_var_str(compiler, "cqto\nidivq %s\nshlq $2, %%rax", arg1);
+    }
+    remove_env(compiler->env, arg1);
+    restore_rdx(compiler, saved);
+  } else {
+    errc(compiler, ExpectedBinary);
+  }
+}
+
 /// Specialized emit_binary for modulo
 void emit_mod(compiler_t *compiler, exprs_t args) {
   if (args.len == 2) {
-    size_t arg1 = get_unused_env(compiler->env);
-    emit_store_expr(compiler, args.arr[1], arg1, 0, 0);
-    emit_expr(compiler, args.arr[0]);
-    if (compiler->env->arr[2].val_type) {
-      size_t tmp = get_unused_env(compiler->env);
-      emit_movq_reg_var(compiler, Rdx, tmp);
-      emit_str(compiler, "cqto");
-      emit_var_str(compiler, "idivq %s", arg1);
-      emit_movq_reg_reg(compiler, Rdx, Rax);
-      emit_movq_var_reg(compiler, tmp, Rdx);
-      remove_env(compiler->env, tmp);
+    ssize_t saved = reserve_rdx(compiler);
+    if (is_strength_num(args.arr[1]) && args.arr[1].num) {
+      emit_expr(compiler, args.arr[0]);
+      emit_mod_imm(compiler, args.arr[1].num);
     } else {
+      size_t arg1 = get_unused_env(compiler->env);
+      emit_store_expr(compiler, args.arr[1], arg1, 0, 0);
+      emit_expr(compiler, args.arr[0]);
       emit_str(compiler, "cqto");
       emit_var_str(compiler, "idivq %s", arg1);
       emit_movq_reg_reg(compiler, Rdx, Rax);
+      remove_env(compiler->env, arg1);
     }
-    remove_env(compiler->env, arg1);
+    restore_rdx(compiler, saved);
   } else {
     errc(compiler, ExpectedBinary);
   }
@@ -1071,14 +1408,21 @@ void emit_letstar(compiler_t *compiler, exprs_t rest) {
       push_var_env(compiler->env, strdup(binds->arr[i].exprs->arr[0].str),
                    Unknown, reg, Mutable);
       compiler->env->rarr[reg].variable = 1;
-      if (!emit_load_bind(compiler, binds->arr[i], reg, compiler->env->len - 1,
-                          1)) {
+      push_later(compiler, slice_start_exprs(&rest, 1));
+      push_later(compiler, slice_start_exprs(binds, i + 1));
+      int loaded = emit_load_bind(compiler, binds->arr[i], reg,
+                                  compiler->env->len - 1, 1);
+      pop_later(compiler);
+      pop_later(compiler);
+      if (!loaded) {
         return;
       }
       compiler->env->arr[compiler->env->len - 1].active = 1;
     }
     for (size_t i = 1; i < rest.len; i++) {
+      push_later(compiler, slice_start_exprs(&rest, i + 1));
       emit_expr(compiler, rest.arr[i]);
+      pop_later(compiler);
     }
     for (size_t i = 0; i < binds->len; i++) {
       pop_var_env(compiler->env);
@@ -1098,8 +1442,13 @@ void emit_let(compiler_t *compiler, exprs_t rest) {
       push_var_env(compiler->env, strdup(binds->arr[i].exprs->arr[0].str),
                    Unknown, reg, Mutable);
       compiler->env->rarr[reg].variable = 1;
-      if (!emit_load_bind(compiler, binds->arr[i], reg, compiler->env->len - 1,
-                          1)) {
+      push_later(compiler, slice_start_exprs(&rest, 1));
+      push_later(compiler, slice_start_exprs(binds, i + 1));
+      int loaded = emit_load_bind(compiler, binds->arr[i], reg,
+                                  compiler->env->len - 1, 1);
+      pop_later(compiler);
+      pop_later(compiler);
+      if (!loaded) {
         return;
       }
     }
@@ -1107,7 +1456,9 @@ void emit_let(compiler_t *compiler, exprs_t rest) {
       compiler->env->arr[compiler->env->len - 1].active = 1;
     }
     for (size_t i = 1; i < rest.len; i++) {
+      push_later(compiler, slice_start_exprs(&rest, i + 1));
       emit_expr(compiler, rest.arr[i]);
+      pop_later(compiler);
     }
     for (size_t i = 0; i < binds->len; i++) {
       pop_var_env(compiler->env);
@@ -1122,7 +1473,9 @@ void emit_let(compiler_t *compiler, exprs_t rest) {
 void emit_if(compiler_t *compiler, exprs_t rest) {
   if (rest.len == 2) {
     size_t l0 = compiler->label++;
+    push_later(compiler, slice_start_exprs(&rest, 1));
     emit_expr(compiler, rest.arr[0]); // Test
+    pop_later(compiler);
     emit_size_str(compiler, "cmpq $31, %rax\nje L%zu", l0);
     emit_expr(compiler, rest.arr[1]);
     emit_size_str(compiler, "L%zu:", l0);
@@ -1130,7 +1483,9 @@ void emit_if(compiler_t *compiler, exprs_t rest) {
   } else if (rest.len == 3) {
     size_t l0 = compiler->label++;
     size_t l1 = compiler->label++;
+    push_later(compiler, slice_start_exprs(&rest, 1));
     emit_expr(compiler, rest.arr[0]); // Test
+    pop_later(compiler);
     emit_size_str(compiler, "cmpq $31, %rax\nje L%zu", l0);
     emit_expr(compiler, rest.arr[1]);
     emit_size_str(compiler, "jmp L%zu", l1);
@@ -1147,18 +1502,25 @@ void emit_if(compiler_t *compiler, exprs_t rest) {
 
 void emit_cons(compiler_t *compiler, exprs_t rest) {
   if (rest.len == 2) {
-    collect(compiler, 16);
+    // Both halves are evaluated first, as allocating in them would take the
+    // room checked for the pair
     size_t arg1 = get_unused_env(compiler->env);
     emit_store_expr(compiler, rest.arr[1], arg1, 0, 0);
-    emit_expr(compiler, rest.arr[0]);
+    size_t arg0 = get_unused_env(compiler->env);
+    emit_store_expr(compiler, rest.arr[0], arg0, 0, 0);
+    collect(compiler, 24);
+    size_t site = count_alloc(compiler, OBJ_PAIR, 24);
     emit_str(compiler, "movq gen0_ptr(%rip), %r14");
-    emit_movq_reg_regmem(compiler, Rax, 0, R14);
-    emit_movq_var_regmem(compiler, arg1, 8, R14);
+    emit_size_str(compiler, "movabsq $%zu, %%rax\nmovq %%rax, (%%r14)",
+                  make_hdr(OBJ_PAIR, 3) | site << HDR_ARITY_SHIFT);
+    emit_movq_var_regmem(compiler, arg0, 8, R14);
+    emit_movq_var_regmem(compiler, arg1, 16, R14);
     emit_movq_reg_reg(compiler, R14, Rax);
-    emit_orq_imm_reg(compiler, 1, Rax);
-    emit_str(compiler, "addq $16, gen0_ptr(%rip)");
+    emit_orq_imm_reg(compiler, OBJ_PAIR, Rax);
+    emit_str(compiler, "addq $24, gen0_ptr(%rip)");
+    remove_env(compiler->env, arg0);
     remove_env(compiler->env, arg1);
-    compiler->heap += 16;
+    compiler->heap += 24;
   } else {
     compiler->line = rest.arr[0].line;
     compiler->loc = rest.arr[0].loc;
@@ -1169,43 +1531,42 @@ void emit_cons(compiler_t *compiler, exprs_t rest) {
 // PERF: Consider the case of a fixnum in the first argument, generates less
 // noise
 void emit_mkvec(compiler_t *compiler, exprs_t rest) {
-  if (rest.len == 1) {
-    emit_expr(compiler, rest.arr[0]);
-    collect_retq(compiler, 8);
-    size_t len = get_unused_env(compiler->env);
-    emit_store_expr(compiler, rest.arr[0], len, 0, 0);
-    emit_var_str(compiler, "movq gen0_ptr(%%rip), %%r14", len);
-    emit_movq_var_regmem(compiler, len, 0, R14);
-    emit_movq_reg_reg(compiler, R14, Rax);
-    emit_orq_imm_reg(compiler, 2, Rax);
-    emit_str(compiler, "movq gen0_ptr(%rip), %r14");
-    emit_var_str(compiler, "leaq 8(%%r14,%s,2), %%r14", len);
-    emit_str(compiler, "movq %r14, gen0_ptr(%rip)");
-    remove_env(compiler->env, len);
-    compiler->heap += 8;
-  } else if (rest.len == 2) {
-    emit_expr(compiler, rest.arr[0]);
-    collect_retq(compiler, 8);
+  if (rest.len == 1 || rest.len == 2) {
     size_t label = compiler->label++;
     size_t len = get_unused_env(compiler->env);
-    size_t counter = get_unused_env(compiler->env);
     emit_store_expr(compiler, rest.arr[0], len, 0, 0);
-    emit_expr(compiler, rest.arr[1]);
-    emit_str(compiler, "movq gen0_ptr(%rip), %r14");
-    emit_movq_var_regmem(compiler, len, 0, R14);
+    size_t fill = get_unused_env(compiler->env);
+    // The fill is evaluated before allocating so nothing can collect while
+    // the vector is only partly written, and an unfilled vector is zeroed so
+    // the GC never scans garbage
+    if (rest.len == 2) {
+      emit_store_expr(compiler, rest.arr[1], fill, 0, 0);
+    } else {
+      emit_movq_imm_var(compiler, 0, fill);
+    }
+    emit_movq_var_reg(compiler, len, Rax);
+    emit_str(compiler, "leaq 8(,%rax,2), %rax");
+    size_t site = count_alloc(compiler, OBJ_VEC, 0);
+    alloc_ret(compiler, OBJ_VEC);
+    emit_movq_var_reg(compiler, len, Rax);
+    emit_str(compiler, "shrq $2, %rax\nincq %rax");
+    emit_size_str(compiler, "shlq $%zu, %%rax", HDR_WORDS_SHIFT);
+    emit_size_str(compiler, "orq $%zu, %%rax",
+                  OBJ_VEC | site << HDR_ARITY_SHIFT);
+    emit_str(compiler, "movq %rax, (%r14)");
+    size_t counter = get_unused_env(compiler->env);
     emit_movq_var_var(compiler, len, counter);
     emit_var_str(compiler, "shr $2, %s", counter);
+    emit_size_str(compiler, "jz L%zu_end", label);
     emit_size_str(compiler, "L%zu:", label);
-    emit_movq_reg_fullmem(compiler, Rax, 0, R14, counter + 1, 8);
+    emit_movq_var_fullmem(compiler, fill, 0, R14, counter + 1, 8);
     emit_decq_var(compiler, counter);
-    emit_var_str(compiler, "cmpq $0, %s", counter);
     emit_size_str(compiler, "jne L%zu", label);
+    emit_size_str(compiler, "L%zu_end:", label);
     emit_movq_reg_reg(compiler, R14, Rax);
     emit_orq_imm_reg(compiler, 2, Rax);
-    emit_str(compiler, "movq gen0_ptr(%rip), %r14");
-    emit_var_str(compiler, "leaq 8(%%r14,%s,2), %%r14", len);
-    emit_str(compiler, "movq %r14, gen0_ptr(%rip)");
     remove_env(compiler->env, len);
+    remove_env(compiler->env, fill);
     remove_env(compiler->env, counter);
     compiler->heap += 8;
   } else {
@@ -1220,15 +1581,34 @@ void emit_mkvec(compiler_t *compiler, exprs_t rest) {
 }
 
 void emit_vector(compiler_t *compiler, exprs_t args) {
+  // Elements other than atoms are evaluated first, like the halves of a pair,
+  // as they would clobber rax or collect while it holds the vector
+  ssize_t *temps = malloc(sizeof(*temps) * args.len);
+  for (size_t i = 0; i < args.len; i++) {
+    enum expr type = args.arr[i].type;
+    if (type == Symb || type == Null || type == Num || type == Chr ||
+        type == UniChr || type == Bool) {
+      temps[i] = -1;
+    } else {
+      temps[i] = get_unused_env(compiler->env);
+      emit_store_expr(compiler, args.arr[i], temps[i], 0, 0);
+    }
+  }
   exprs_t *arg_len = create_exprs(1);
   push_exprs(arg_len, (expr_t){.type = Num, .num = args.len});
   emit_mkvec(compiler, *arg_len);
   size_t obj = get_unused_env(compiler->env);
   for (size_t i = 0; i < args.len; i++) {
-    emit_store_expr(compiler, args.arr[i], obj, 0, 0);
-    emit_movq_var_regmem(compiler, obj, 6 + (i << 3), Rax);
+    if (temps[i] == -1) {
+      emit_store_expr(compiler, args.arr[i], obj, 0, 0);
+      emit_movq_var_regmem(compiler, obj, 6 + (i << 3), Rax);
+    } else {
+      emit_movq_var_regmem(compiler, temps[i], 6 + (i << 3), Rax);
+      remove_env(compiler->env, temps[i]);
+    }
   }
   remove_env(compiler->env, obj);
+  free(temps);
   compiler->ret_type = Vector;
 }
 
@@ -1246,6 +1626,66 @@ void emit_vecref(compiler_t *compiler, exprs_t rest) {
   }
 }
 
+/// Logs the slot whose address is in `slot` while an incremental collection
+/// runs. A full log is only flagged, like a full remembered set.
+void emit_barrier_log(compiler_t *compiler, size_t slot) {
+  size_t label = compiler->label++;
+  size_t full = compiler->label++;
+  emit_str(compiler, "cmpb $0, inc_active(%rip)");
+  emit_size_str(compiler, "je L%zu", label);
+  emit_str(compiler, "movq inc_log_ptr(%rip), %r14");
+  emit_str(compiler, "cmpq inc_log_end(%rip), %r14");
+  emit_size_str(compiler, "jae L%zu", full);
+  emit_movq_var_regmem(compiler, slot, 0, R14);
+  emit_str(compiler, "addq $8, inc_log_ptr(%rip)");
+  emit_size_str(compiler, "jmp L%zu", label);
+  emit_size_str(compiler, "L%zu:", full);
+  emit_str(compiler, "movb $1, remset_full(%rip)");
+  emit_size_str(compiler, "L%zu:", label);
+}
+
+/// Write barrier for a store of `val` to the slot whose address is in
+/// `slot`. Past the log, the slot is recorded in the remembered set if `val`
+/// points into the nursery, unless the slot is itself in the nursery.
+/// In card mode, slots in gen1 only mark their card, and the set is left for
+/// slots elsewhere such as quotes.
+/// A full remembered set is only flagged, which makes the next collection a
+/// major one.
+void emit_barrier(compiler_t *compiler, size_t val, size_t slot) {
+  size_t label = compiler->label++;
+  size_t full = compiler->label++;
+  emit_barrier_log(compiler, slot);
+  emit_movq_var_reg(compiler, val, R14);
+  emit_str(compiler, "subq nursery_lo(%rip), %r14");
+  emit_str(compiler, "cmpq nursery_len(%rip), %r14");
+  emit_size_str(compiler, "jae L%zu", label);
+  if (compiler->barrier == Card) {
+    size_t outside = compiler->label++;
+    emit_movq_var_reg(compiler, slot, R14);
+    emit_str(compiler, "subq card_base(%rip), %r14");
+    emit_str(compiler, "cmpq card_len(%rip), %r14");
+    emit_size_str(compiler, "jae L%zu", outside);
+    emit_str(compiler, "shrq $9, %r14");
+    emit_str(compiler, "addq card_table(%rip), %r14");
+    emit_str(compiler, "movb $1, (%r14)");
+    emit_size_str(compiler, "jmp L%zu", label);
+    emit_size_str(compiler, "L%zu:", outside);
+  }
+  emit_movq_var_reg(compiler, slot, R14);
+  emit_str(compiler, "subq nursery_lo(%rip), %r14");
+  emit_str(compiler, "cmpq nursery_len(%rip), %r14");
+  emit_size_str(compiler, "jb L%zu", label);
+  emit_str(compiler, "movq remset_ptr(%rip), %r14");
+  emit_str(compiler, "cmpq remset_end(%rip), %r14");
+  emit_size_str(compiler, "jae L%zu", full);
+  emit_movq_var_regmem(compiler, slot, 0, R14);
+  emit_str(compiler, "addq $8, remset_ptr(%rip)");
+  emit_size_str(compiler, "jmp L%zu", label);
+  emit_size_str(compiler, "L%zu:", full);
+  emit_str(compiler, "movb $1, remset_full(%rip)");
+  emit_size_str(compiler, "L%zu:", label);
+}
+
 void emit_vecset(compiler_t *compiler, exprs_t rest) {
   if (rest.len == 3) {
     size_t obj = get_unused_env(compiler->env);
@@ -1254,6 +1694,10 @@ void emit_vecset(compiler_t *compiler, exprs_t rest) {
     emit_store_expr(compiler, rest.arr[1], loc, 0, 0);
     emit_expr(compiler, rest.arr[0]);
     emit_movq_var_fullmem(compiler, obj, 6, Rax, loc + 1, 2);
+    emit_movq_var_reg(compiler, loc, R14);
+    emit_str(compiler, "leaq 6(%rax,%r14,2), %r14");
+    emit_movq_reg_var(compiler, R14, loc);
+    emit_barrier(compiler, obj, loc);
     remove_env(compiler->env, obj);
     remove_env(compiler->env, loc);
   } else {
@@ -1263,57 +1707,77 @@ void emit_vecset(compiler_t *compiler, exprs_t rest) {
   }
 }
 
+/// The inline part of make-string, a byte per character and filled with the
+/// ASCII character in `fill` if `has_fill`
+void emit_mkstr_bytes(compiler_t *compiler, int utf8, size_t label, size_t len,
+                      size_t fill, int has_fill) {
+  emit_movq_var_reg(compiler, len, Rax);
+  emit_str(compiler, "shrq $2, %rax\naddq $23, %rax\nandq $-8, %rax");
+  size_t site = count_alloc(compiler, OBJ_STR, 0);
+  alloc_ret(compiler, OBJ_STR);
+  // The header counts whole words, and the bytes the last one leaves unused.
+  // Each byte is a code point until the caller says otherwise.
+  emit_movq_var_reg(compiler, len, Rax);
+  emit_str(compiler, "shrq $2, %rax\nmovq %rax, 8(%r14)");
+  emit_str(compiler, "addq $23, %rax\nshrq $3, %rax");
+  emit_size_str(compiler, "shlq $%zu, %%rax", HDR_WORDS_SHIFT);
+  emit_str(compiler, "movq %rax, (%r14)");
+  emit_movq_var_reg(compiler, len, Rax);
+  emit_str(compiler, "shrq $2, %rax\nnegq %rax\nandq $7, %rax");
+  emit_size_str(compiler, "shlq $%zu, %%rax", HDR_PAD_SHIFT);
+  emit_size_str(compiler, "orq $%zu, %%rax",
+                OBJ_STR | (utf8 ? HDR_UTF8 : 0) | site << HDR_ARITY_SHIFT);
+  emit_str(compiler, "orq %rax, (%r14)");
+  size_t counter = get_unused_env(compiler->env);
+  if (has_fill) {
+    emit_var_str(compiler, "shrq $8, %s", fill);
+    emit_movq_var_var(compiler, len, counter);
+    emit_var_str(compiler, "shr $2, %s", counter);
+    emit_size_str(compiler, "jz L%zu_end", label);
+    emit_size_str(compiler, "L%zu:", label);
+    emit_movb_var_fullmem(compiler, fill, 15, R14, counter + 1, 1);
+    emit_decq_var(compiler, counter);
+    emit_size_str(compiler, "jne L%zu", label);
+    emit_size_str(compiler, "L%zu_end:", label);
+  }
+  emit_movq_reg_reg(compiler, R14, Rax);
+  emit_orq_imm_reg(compiler, 3, Rax);
+  remove_env(compiler->env, counter);
+}
+
 // PERF: Consider the case of a fixnum in the first argument, generates less
 // noise
 void emit_mkstr(compiler_t *compiler, int utf8, exprs_t rest) {
-  if (rest.len == 1) {
-    emit_expr(compiler, rest.arr[0]);
-    emit_str(compiler, "shrq $2, %rax");
-    collect_retb(compiler, 8);
-    size_t len = get_unused_env(compiler->env);
-    emit_store_expr(compiler, rest.arr[0], len, 0, 0);
-    emit_var_str(compiler, "movq gen0_ptr(%%rip), %%r14", len);
-    emit_var_str(compiler, "shlq $1, %s", len);
-    if (utf8) {
-      emit_var_str(compiler, "orq $1, %s", len);
-    }
-    emit_movq_var_regmem(compiler, len, 0, R14);
-    emit_movq_reg_reg(compiler, R14, Rax);
-    emit_orq_imm_reg(compiler, 3, Rax);
-    emit_str(compiler, "movq gen0_ptr(%rip), %r14");
-    emit_var_str(compiler, "leaq 8(%%r14,%s), %%r14", len);
-    emit_str(compiler, "movq %r14, gen0_ptr(%rip)");
-    remove_env(compiler->env, len);
-    compiler->heap += 8;
-  } else if (rest.len == 2) {
-    emit_expr(compiler, rest.arr[0]);
-    emit_str(compiler, "shrq $2, %rax");
-    collect_retb(compiler, 8);
+  if (rest.len == 1 || rest.len == 2) {
     size_t label = compiler->label++;
     size_t len = get_unused_env(compiler->env);
-    size_t counter = get_unused_env(compiler->env);
     emit_store_expr(compiler, rest.arr[0], len, 0, 0);
-    emit_expr(compiler, rest.arr[1]);
-    emit_str(compiler, "movq gen0_ptr(%rip), %r14");
-    emit_var_str(compiler, "shlq $1, %s", len);
-    if (utf8) {
-      emit_var_str(compiler, "orq $1, %s", len);
+    size_t fill = get_unused_env(compiler->env);
+    enum val_type fill_type = Char;
+    if (rest.len == 2) {
+      emit_store_expr(compiler, rest.arr[1], fill, 0, 0);
+      fill_type = compiler->env->rarr[fill].type;
+    }
+    // A fill beyond ASCII takes several bytes per character, which the
+    // runtime lays out
+    if (fill_type != Char) {
+      size_t ascii = compiler->label++;
+      if (fill_type != UniChar) {
+        emit_var_str(compiler, "testq $0x8000, %s", fill);
+        emit_size_str(compiler, "jz L%zu", ascii);
+      }
+      emit_collecting_call(compiler, "make_string", (size_t[]){len, fill}, 2);
+      emit_size_str(compiler, "jmp L%zu_done", label);
+      emit_size_str(compiler, "L%zu:", ascii);
+    }
+    if (fill_type != UniChar) {
+      emit_mkstr_bytes(compiler, utf8, label, len, fill, rest.len == 2);
+    }
+    if (fill_type != Char) {
+      emit_size_str(compiler, "L%zu_done:", label);
     }
-    emit_movq_var_regmem(compiler, len, 0, R14);
-    emit_movq_var_var(compiler, len, counter);
-    emit_var_str(compiler, "shr $3, %s", counter);
-    emit_size_str(compiler, "L%zu:", label);
-    emit_movb_reg_fullmem(compiler, Rax, 0, R14, counter + 1, 1);
-    emit_decq_var(compiler, counter);
-    emit_var_str(compiler, "cmpq $0, %s", counter);
-    emit_size_str(compiler, "jne L%zu", label);
-    emit_movq_reg_reg(compiler, R14, Rax);
-    emit_orq_imm_reg(compiler, 3, Rax);
-    emit_str(compiler, "movq gen0_ptr(%rip), %r14");
-    emit_var_str(compiler, "leaq 8(%%r14,%s), %%r14", len);
-    emit_str(compiler, "movq %r14, gen0_ptr(%rip)");
     remove_env(compiler->env, len);
-    remove_env(compiler->env, counter);
+    remove_env(compiler->env, fill);
     compiler->heap += 8;
   } else {
     compiler->line = rest.arr[0].line;
@@ -1334,10 +1798,15 @@ void emit_string_c(compiler_t *compiler, const char *cstr) {
   size_t obj = get_unused_env(compiler->env);
   for (size_t i = 0; i < strlen(cstr); i++) {
     emit_movq_imm_var(compiler, cstr[i], obj);
-    emit_movb_var_regmem(compiler, obj, 5 + i, Rax);
+    emit_movb_var_regmem(compiler, obj, 13 + i, Rax);
   }
   remove_env(compiler->env, obj);
   if (utf8) {
+    size_t count = 0;
+    for (size_t i = 0; i < strlen(cstr); i++) {
+      count += (cstr[i] & 0xc0) != 0x80;
+    }
+    emit_size_str(compiler, "movq $%zu, 5(%%rax)", count);
     compiler->ret_type = UniString;
   } else {
     compiler->ret_type = String;
@@ -1345,105 +1814,63 @@ void emit_string_c(compiler_t *compiler, const char *cstr) {
 }
 
 void emit_string(compiler_t *compiler, exprs_t args) {
-  exprs_t *arg_len = create_exprs(1);
-  push_exprs(arg_len, (expr_t){.type = Num, .num = args.len});
-  emit_mkstr(compiler, 0, *arg_len);
-  size_t obj = get_unused_env(compiler->env);
-  int utf8 = 0;
-  for (size_t i = 0; i < args.len; i++) {
-    emit_store_expr(compiler, args.arr[i], obj, 0, 0);
-    if (!utf8 && compiler->env->arr[obj].val_type == UniChar) {
-      emit_str(compiler, "orq $1, -3(%rax)");
-      utf8 = 1;
+  // Literal characters are laid out at compile time, like a literal string
+  char *cstr = malloc(args.len * 4 + 1);
+  size_t len = 0;
+  size_t i = 0;
+  for (; i < args.len; i++) {
+    if (args.arr[i].type == Chr && args.arr[i].ch) {
+      cstr[len++] = args.arr[i].ch;
+    } else if (args.arr[i].type == UniChr) {
+      for (size_t bytes = tag_unichar(args.arr[i].uch) >> 8; bytes;
+           bytes >>= 8) {
+        cstr[len++] = bytes;
+      }
+    } else {
+      break;
     }
-    emit_var_str(compiler, "shrq $8, %s", obj);
-    emit_movb_var_regmem(compiler, obj, 5 + i, Rax);
   }
-  remove_env(compiler->env, obj);
-  if (utf8) {
-    compiler->ret_type = UniString;
-  } else {
-    compiler->ret_type = String;
+  cstr[len] = 0;
+  if (i == args.len) {
+    emit_string_c(compiler, cstr);
+    free(cstr);
+    return;
   }
+  free(cstr);
+  // Otherwise their widths are only known once they are, so they are kept on
+  // the root stack until the runtime allocates for all of them
+  for (i = 0; i < args.len; i++) {
+    emit_expr(compiler, args.arr[i]);
+    emit_str(compiler, "movq %rax, (%r15)\naddq $8, %r15");
+  }
+  size_t chars = get_unused_env(compiler->env);
+  size_t count = get_unused_env(compiler->env);
+  emit_size_str(compiler, "leaq -%zu(%%r15), %%r14", args.len * 8);
+  emit_movq_reg_var(compiler, R14, chars);
+  emit_movq_imm_var(compiler, tag_fixnum(args.len), count);
+  compiler->env->rarr[chars].type = Fixnum;
+  compiler->env->rarr[count].type = Fixnum;
+  emit_collecting_call(compiler, "string_chars", (size_t[]){chars, count}, 2);
+  emit_size_str(compiler, "subq $%zu, %%r15", args.len * 8);
+  remove_env(compiler->env, count);
+  remove_env(compiler->env, chars);
+  compiler->heap += 8;
+  compiler->ret_type = String;
+}
+
+/// Loads the length in bytes of the string in %rax, from the words its header
+/// counts less the code point count and the bytes the last one leaves unused
+void emit_strbytes(compiler_t *compiler) {
+  emit_str(compiler, "movq -3(%rax), %rax\nmovq %rax, %r14");
+  emit_size_str(compiler, "shrq $%zu, %%r14\nandq $7, %%r14", HDR_PAD_SHIFT);
+  emit_size_str(compiler, "shrq $%zu, %%rax", HDR_WORDS_SHIFT);
+  emit_str(compiler, "leaq -16(,%rax,8), %rax\nsubq %r14, %rax");
 }
 
 void emit_strlen(compiler_t *compiler, exprs_t rest) {
   if (rest.len == 1) {
     emit_expr(compiler, rest.arr[0]);
-    if (compiler->ret_type == UniString) {
-      size_t obj = get_unused_env(compiler->env);
-      size_t len = get_unused_env(compiler->env);
-      size_t tmp = get_unused_env(compiler->env);
-      size_t l0 = compiler->label++;
-      size_t l1 = compiler->label++;
-      size_t l2 = compiler->label++;
-      emit_movq_reg_var(compiler, Rax, obj);
-      emit_movq_regmem_reg(compiler, -3, Rax, Rax);
-      emit_movq_reg_var(compiler, Rax, len);
-      emit_var_str(compiler, "shrq $3, %s", len);
-      emit_movq_imm_reg(compiler, -1, Rax);
-      emit_size_str(compiler, "L%zu:", l0);
-      emit_str(compiler, "incq %rax");
-      emit_size_str(compiler, "L%zu:", l1);
-      emit_var_str(compiler, "cmpq $0, %s", len);
-      emit_size_str(compiler, "je L%zu", l2);
-      emit_decq_var(compiler, len);
-      emit_movb_fullmem_var(compiler, 5, obj + 1, len + 1, 1, tmp);
-      // NOTE: This looks fun, but it was tested on a pretty old hardware
-      emit_shlb_imm_var(compiler, 1, tmp);
-      emit_size_str(compiler, "js L%zu", l0);
-      emit_size_str(compiler, "jc L%zu", l1);
-      emit_size_str(compiler, "jmp L%zu", l0);
-      emit_size_str(compiler, "L%zu:", l2);
-      emit_str(compiler, "shlq $2, %rax");
-      remove_env(compiler->env, tmp);
-      remove_env(compiler->env, len);
-      remove_env(compiler->env, obj);
-      return;
-    } else if (compiler->ret_type == String) {
-      emit_movq_regmem_reg(compiler, -3, Rax, Rax);
-      emit_str(compiler, "shrq $1, %rax");
-      return;
-    }
-    size_t obj = get_unused_env(compiler->env);
-    size_t len = get_unused_env(compiler->env);
-    size_t count = get_unused_env(compiler->env);
-    size_t l0 = compiler->label++;
-    size_t l1 = compiler->label++;
-    size_t l2 = compiler->label++;
-    size_t l3 = compiler->label++;
-    size_t l4 = compiler->label++;
-    emit_movq_reg_var(compiler, Rax, obj);
-    emit_movq_regmem_reg(compiler, -3, Rax, Rax);
-    emit_movq_reg_var(compiler, Rax, len);
-    emit_str(compiler, "andq $1, %rax\ncmpq $0, %rax");
-    emit_size_str(compiler, "je L%zu", l0);
-    // >ascii, so do utf8_strlen
-    emit_var_str(compiler, "shrq $3, %s", len);
-    emit_var_str(compiler, "movq $-1, %s", count);
-    emit_size_str(compiler, "L%zu:", l3);
-    emit_var_str(compiler, "incq %s", count);
-    emit_size_str(compiler, "L%zu:", l2);
-    emit_var_str(compiler, "cmpq $0, %s", len);
-    emit_size_str(compiler, "je L%zu", l4);
-    emit_decq_var(compiler, len);
-    emit_movb_fullmem_reg(compiler, 5, obj + 1, len + 1, 1, Rax);
-    emit_str(compiler, "shlb $1, %al");
-    emit_size_str(compiler, "js L%zu", l3);
-    emit_size_str(compiler, "jc L%zu", l2);
-    emit_size_str(compiler, "jmp L%zu", l3);
-    emit_size_str(compiler, "L%zu:", l4);
-    emit_movq_var_reg(compiler, count, Rax);
-    emit_str(compiler, "shlq $2, %rax");
-    emit_size_str(compiler, "jmp L%zu", l1);
-    // ascii, so just returns chars
-    emit_size_str(compiler, "L%zu:", l0);
-    emit_var_str(compiler, "shrq $1, %s", len);
-    emit_movq_var_reg(compiler, len, Rax);
-    emit_size_str(compiler, "L%zu:", l1);
-    remove_env(compiler->env, count);
-    remove_env(compiler->env, len);
-    remove_env(compiler->env, obj);
+    emit_str(compiler, "movq 5(%rax), %rax\nshlq $2, %rax");
   } else {
     compiler->line = rest.arr[0].line;
     compiler->loc = rest.arr[0].loc;
@@ -1452,47 +1879,30 @@ void emit_strlen(compiler_t *compiler, exprs_t rest) {
 }
 
 void emit_unistrref(compiler_t *compiler, size_t obj, size_t loc) {
-  // Navigate to the code point
-  size_t tmp = get_unused_env(compiler->env);
+  // Navigate to the code point, through the offsets the runtime keeps for
+  // long strings
+  size_t base = spill_args(compiler, 0);
+  emit_movq_var_reg(compiler, obj, Rax);
+  emit_movq_var_reg(compiler, loc, R14);
+  emit_str(compiler, "movq %rax, %rdi\nmovq %r14, %rsi\nshrq $2, %rsi");
+  emit_str(compiler, "callq utf8_offset");
+  reorganize_args(compiler, base);
+  // Get its bytes, as many as the first one says
   size_t l0 = compiler->label++;
   size_t l1 = compiler->label++;
-  emit_var_str(compiler, "shrq $2, %s", loc);
-  emit_movq_imm_reg(compiler, -1, Rax);
+  emit_movq_var_reg(compiler, obj, R14);
+  emit_str(compiler, "addq %rax, %r14\nmovzbl 13(%r14), %eax");
+  emit_str(compiler, "cmpl $0x80, %eax");
+  emit_size_str(compiler, "jb L%zu", l1);
+  emit_str(compiler, "cmpl $0xe0, %eax");
+  emit_size_str(compiler, "jae L%zu", l0);
+  emit_str(compiler, "movzwl 13(%r14), %eax");
+  emit_size_str(compiler, "jmp L%zu", l1);
   emit_size_str(compiler, "L%zu:", l0);
-  emit_incq_reg(compiler, Rax);
-  emit_movb_fullmem_var(compiler, 5, obj + 1, Rax, 1, tmp);
-  emit_shlb_imm_var(compiler, 1, tmp);
-  emit_size_str(compiler, "js L%zu", l1);
-  emit_size_str(compiler, "jc L%zu", l0);
-  emit_size_str(compiler, "L%zu:", l1);
-  emit_decq_var(compiler, loc);
-  emit_var_str(compiler, "cmpq $0, %s", loc);
-  emit_size_str(compiler, "jge L%zu", l0);
-  // Get it and convert to Char
-  size_t l2 = compiler->label++;
-  size_t l3 = compiler->label++;
-  size_t l4 = compiler->label++;
-  size_t l5 = compiler->label++;
-  emit_movb_fullmem_var(compiler, 5, obj + 1, Rax, 1, tmp);
-  emit_shlb_imm_var(compiler, 1, tmp);
-  emit_size_str(compiler, "js L%zu", l2);
-  emit_movb_fullmem_reg(compiler, 5, obj + 1, Rax, 1, Rax);
-  emit_size_str(compiler, "jmp L%zu", l5);
-  emit_size_str(compiler, "L%zu:", l2);
-  emit_shlb_imm_var(compiler, 1, tmp);
-  emit_size_str(compiler, "js L%zu", l3);
-  emit_movw_fullmem_reg(compiler, 5, obj + 1, Rax, 1, Rax);
-  emit_size_str(compiler, "jmp L%zu", l5);
-  emit_size_str(compiler, "L%zu:", l3);
-  emit_shlb_imm_var(compiler, 1, tmp);
-  emit_size_str(compiler, "js L%zu", l4);
-  emit_movl_fullmem_reg(compiler, 5, obj + 1, Rax, 1, Rax);
+  emit_str(compiler, "cmpl $0xf0, %eax\nmovl 13(%r14), %eax");
+  emit_size_str(compiler, "jae L%zu", l1);
   emit_genins_imm_reg(compiler, "andl", regl_to_str, 0x00ffffff, Rax);
-  emit_size_str(compiler, "jmp L%zu", l5);
-  emit_size_str(compiler, "L%zu:", l4);
-  emit_movl_fullmem_reg(compiler, 5, obj + 1, Rax, 1, Rax);
-  emit_size_str(compiler, "L%zu:", l5);
-  remove_env(compiler->env, tmp);
+  emit_size_str(compiler, "L%zu:", l1);
 }
 
 void emit_strref(compiler_t *compiler, exprs_t rest) {
@@ -1501,37 +1911,27 @@ void emit_strref(compiler_t *compiler, exprs_t rest) {
     size_t loc = get_unused_env(compiler->env);
     emit_store_expr(compiler, rest.arr[0], obj, 0, 0);
     emit_store_expr(compiler, rest.arr[1], loc, 0, 0);
-    if (compiler->env->arr[obj].val_type == UniString) {
-      emit_unistrref(compiler, obj, loc);
-      emit_shlq_imm_reg(compiler, 8, Rax);
-      emit_orq_imm_reg(compiler, 15, Rax);
-      remove_env(compiler->env, loc);
-      remove_env(compiler->env, obj);
-      compiler->ret_type = UniChar;
-      return;
-    } else if (compiler->env->arr[obj].val_type == String) {
-      emit_var_str(compiler, "shrq $2, %s", loc);
-      emit_str(compiler, "xorl %eax, %eax");
-      emit_movb_fullmem_reg(compiler, 5, obj + 1, loc + 1, 1, Rax);
-      emit_shlq_imm_reg(compiler, 8, Rax);
-      emit_orq_imm_reg(compiler, 15, Rax);
-      remove_env(compiler->env, loc);
-      remove_env(compiler->env, obj);
-      compiler->ret_type = Char;
-      return;
-    }
+    // Static types can't tell whether string-set! widened the string since
     size_t l0 = compiler->label++;
     size_t l1 = compiler->label++;
-    emit_movq_regmem_reg(compiler, -3, Rax, Rax);
-    emit_str(compiler, "andq $1, %rax\ncmpq $0, %rax");
-    emit_size_str(compiler, "je L%zu", l0);
-    emit_unistrref(compiler, obj, loc);
-    emit_size_str(compiler, "jmp L%zu", l1);
+    size_t l2 = compiler->label++;
+    emit_movq_var_reg(compiler, obj, Rax);
+    emit_size_str(compiler, "testl $%zu, -3(%%rax)", HDR_UTF8 | HDR_WIDE);
+    emit_size_str(compiler, "jne L%zu", l0);
+    emit_movq_var_reg(compiler, loc, R14);
+    emit_str(compiler, "shrq $2, %r14\nmovzbl 13(%rax, %r14), %eax");
+    emit_size_str(compiler, "jmp L%zu", l2);
     emit_size_str(compiler, "L%zu:", l0);
-    emit_var_str(compiler, "shrq $2, %s", loc);
-    emit_str(compiler, "xorl %eax, %eax");
-    emit_movb_fullmem_reg(compiler, 5, obj + 1, loc + 1, 1, Rax);
+    emit_size_str(compiler, "testl $%zu, -3(%%rax)", HDR_WIDE);
+    emit_size_str(compiler, "je L%zu", l1);
+    // Cells are 4 bytes, as much as the index is tagged by
+    emit_str(compiler, "movq 13(%rax), %rax");
+    emit_movq_var_reg(compiler, loc, R14);
+    emit_str(compiler, "movl 5(%rax, %r14), %eax");
+    emit_size_str(compiler, "jmp L%zu", l2);
     emit_size_str(compiler, "L%zu:", l1);
+    emit_unistrref(compiler, obj, loc);
+    emit_size_str(compiler, "L%zu:", l2);
     emit_shlq_imm_reg(compiler, 8, Rax);
     emit_orq_imm_reg(compiler, 15, Rax);
     remove_env(compiler->env, loc);
@@ -1544,34 +1944,37 @@ void emit_strref(compiler_t *compiler, exprs_t rest) {
   }
 }
 
-// TODO: THIS IS SIMPLIFIED | HEAVY WIP
 void emit_strset(compiler_t *compiler, exprs_t rest) {
-  // NOTE: Current plan is to reallocate string if it does not fit
   if (rest.len == 3) {
-    if (compiler->ret_type == UniString) {
-      // TODO: Write it
-      return;
-    } else if (compiler->ret_type == String) {
-      size_t obj = get_unused_env(compiler->env);
-      emit_store_expr(compiler, rest.arr[2], obj, 0, 0);
-      // TODO: Implement reallocation
-      if (compiler->env->arr[obj].val_type == UniChar) {
-        compiler->line = rest.arr[0].line;
-        compiler->loc = rest.arr[0].loc;
-        errc(compiler, ExpectedNonUniChar);
-        return;
-      }
-      size_t loc = get_unused_env(compiler->env);
-      emit_store_expr(compiler, rest.arr[1], loc, 0, 0);
-      emit_expr(compiler, rest.arr[0]);
-      emit_var_str(compiler, "shrq $2, %s", loc);
-      emit_movq_var_fullmem(compiler, obj, 5, Rax, loc + 1, 1);
-      remove_env(compiler->env, obj);
-      remove_env(compiler->env, loc);
-      return;
-    }
-    // Branch to either uni or str
-    // TODO: Write it
+    size_t ch = get_unused_env(compiler->env);
+    size_t loc = get_unused_env(compiler->env);
+    size_t obj = get_unused_env(compiler->env);
+    emit_store_expr(compiler, rest.arr[2], ch, 0, 0);
+    emit_store_expr(compiler, rest.arr[1], loc, 0, 0);
+    emit_store_expr(compiler, rest.arr[0], obj, 0, 0);
+    size_t slow = compiler->label++;
+    size_t end = compiler->label++;
+    // ASCII into ASCII is a byte store, anything else a runtime call
+    emit_movq_var_reg(compiler, obj, Rax);
+    emit_size_str(compiler, "testl $%zu, -3(%%rax)", HDR_UTF8 | HDR_WIDE);
+    emit_size_str(compiler, "jne L%zu", slow);
+    emit_movq_var_reg(compiler, ch, R14);
+    emit_str(compiler, "cmpq $0x8000, %r14");
+    emit_size_str(compiler, "jae L%zu", slow);
+    emit_movq_var_reg(compiler, loc, R14);
+    emit_str(compiler, "shrq $2, %r14\nleaq 13(%rax,%r14), %r14");
+    emit_movq_reg_var(compiler, R14, loc);
+    emit_movq_var_reg(compiler, ch, Rax);
+    emit_str(compiler, "shrq $8, %rax\nmovb %al, (%r14)");
+    emit_barrier_log(compiler, loc);
+    emit_size_str(compiler, "jmp L%zu", end);
+    emit_size_str(compiler, "L%zu:", slow);
+    // The runtime may collect to widen the string
+    emit_collecting_call(compiler, "string_set", (size_t[]){obj, loc, ch}, 3);
+    emit_size_str(compiler, "L%zu:", end);
+    remove_env(compiler->env, obj);
+    remove_env(compiler->env, loc);
+    remove_env(compiler->env, ch);
   } else {
     compiler->line = rest.arr[0].line;
     compiler->loc = rest.arr[0].loc;
@@ -1579,13 +1982,221 @@ void emit_strset(compiler_t *compiler, exprs_t rest) {
   }
 }
 
+/// Calls a bulk string primitive of the runtime with the string, index and
+/// character arguments of `rest`, from `min` to `max` of them. Omitted ones
+/// are the start and end of a range, which default to the whole string.
+void emit_strbulk(compiler_t *compiler, const char *fun, exprs_t rest,
+                  size_t min, size_t max) {
+  if (rest.len < min || rest.len > max) {
+    enum err at_least[] = {0, ExpectedAtLeastUnary, ExpectedAtLeastBinary,
+                           ExpectedAtLeastTrinary};
+    enum err at_most[] = {0, 0, 0, ExpectedAtMostTrinary,
+                          ExpectedAtMostQuaternary, ExpectedAtMostQuinary};
+    compiler->line = rest.arr[0].line;
+    compiler->loc = rest.arr[0].loc;
+    if (min == max) {
+      errc(compiler, ExpectedTrinary);
+    } else {
+      errc(compiler, rest.len < min ? at_least[min] : at_most[max]);
+    }
+    return;
+  }
+  size_t vars[5];
+  for (size_t i = 0; i < max; i++) {
+    vars[i] = get_unused_env(compiler->env);
+    if (i < rest.len) {
+      emit_store_expr(compiler, rest.arr[i], vars[i], 0, 0);
+    } else {
+      // An end past any string, clamped by the runtime
+      emit_movq_imm_var(compiler, i == max - 1 ? -4 : 0, vars[i]);
+      compiler->env->rarr[vars[i]].type = Fixnum;
+    }
+  }
+  emit_collecting_call(compiler, fun, vars, max);
+  for (size_t i = max; i-- > 0;) {
+    remove_env(compiler->env, vars[i]);
+  }
+  compiler->heap += 8;
+  compiler->ret_type = String;
+}
+
+void emit_strappend(compiler_t *compiler, exprs_t rest) {
+  // Kept on the root stack until the runtime allocates for all of them
+  for (size_t i = 0; i < rest.len; i++) {
+    emit_expr(compiler, rest.arr[i]);
+    emit_str(compiler, "movq %rax, (%r15)\naddq $8, %r15");
+  }
+  size_t strs = get_unused_env(compiler->env);
+  size_t len = get_unused_env(compiler->env);
+  emit_size_str(compiler, "leaq -%zu(%%r15), %%r14", rest.len * 8);
+  emit_movq_reg_var(compiler, R14, strs);
+  emit_movq_imm_var(compiler, tag_fixnum(rest.len), len);
+  compiler->env->rarr[strs].type = Fixnum;
+  compiler->env->rarr[len].type = Fixnum;
+  emit_collecting_call(compiler, "string_append", (size_t[]){strs, len}, 2);
+  if (rest.len) {
+    emit_size_str(compiler, "subq $%zu, %%r15", rest.len * 8);
+  }
+  remove_env(compiler->env, len);
+  remove_env(compiler->env, strs);
+  compiler->heap += 8;
+  compiler->ret_type = String;
+}
+
+/// Label number of the symbol `name`, laid out in the data section the first
+/// time like a string would be on the heap, and listed in the table the
+/// runtime interns from. Symbols are never moved, so that they compare by
+/// address.
+size_t intern_symb(compiler_t *compiler, const char *name) {
+  ssize_t found = find_strs(compiler->symbs, name);
+  if (found != -1) {
+    return found;
+  }
+  size_t index = compiler->symbs->len;
+  push_strs(compiler->symbs, strdup(name));
+  size_t len = strlen(name);
+  size_t count = 0;
+  for (size_t i = 0; i < len; i++) {
+    count += (name[i] & 0xc0) != 0x80;
+  }
+  size_t words = (len + 23) / sizeof(size_t);
+  size_t hdr = make_hdr(OBJ_SYMB, words) | (-len & 7) << HDR_PAD_SHIFT |
+               (len != count ? HDR_UTF8 : 0);
+  enum emit saved_emit = compiler->emit;
+  compiler->emit = Data;
+  emit_str(compiler, ".data 2");
+  if (!index) {
+    emit_str(compiler, "symbols:");
+  }
+  emit_size_str(compiler, ".quad symb%zu+5\n.data", index);
+  emit_size_str(compiler, ".balign 8\nsymb%zu:", index);
+  {
+    emit_mal_sprintf(".quad %zu, %zu", args(hdr, count));
+  }
+  char *bytes = malloc(sizeof(*bytes) * (len * 5 + 16));
+  size_t at = sprintf(bytes, ".byte %u", (unsigned char)name[0]);
+  for (size_t i = 1; i < len; i++) {
+    at += sprintf(bytes + at, ", %u", (unsigned char)name[i]);
+  }
+  sprintf(bytes + at, "\n.balign 8");
+  emit(compiler, bytes);
+  compiler->emit = saved_emit;
+  return index;
+}
+
+/// Quoted symbols are interned, while other atoms quote to themselves
+void emit_quote(compiler_t *compiler, exprs_t rest) {
+  if (rest.len != 1) {
+    errc(compiler, ExpectedUnary);
+    return;
+  }
+  switch (rest.arr[0].type) {
+  case Symb:
+    emit_size_str(compiler, "leaq symb%zu+5(%%rip), %%rax",
+                  intern_symb(compiler, rest.arr[0].str));
+    compiler->ret_type = Symbol;
+    break;
+  case List:
+  case Vec:
+    compiler->line = rest.arr[0].line;
+    compiler->loc = rest.arr[0].loc;
+    errc(compiler, ExpectedSymb);
+    break;
+  default:
+    emit_expr(compiler, rest.arr[0]);
+  }
+}
+
+/// string->symbol, which doesn't allocate on the heap as symbols live outside
+/// of it
+void emit_strsymb(compiler_t *compiler, exprs_t rest) {
+  if (rest.len != 1) {
+    errc(compiler, ExpectedUnary);
+    return;
+  }
+  emit_expr(compiler, rest.arr[0]);
+  size_t base = spill_args(compiler, 0);
+  emit_str(compiler, "movq %rax, %rdi\ncallq string_to_symbol");
+  reorganize_args(compiler, base);
+  compiler->ret_type = Symbol;
+}
+
+void emit_symbstr(compiler_t *compiler, exprs_t rest) {
+  if (rest.len != 1) {
+    errc(compiler, ExpectedUnary);
+    return;
+  }
+  size_t symb = get_unused_env(compiler->env);
+  emit_store_expr(compiler, rest.arr[0], symb, 0, 0);
+  emit_collecting_call(compiler, "symbol_to_string", &symb, 1);
+  remove_env(compiler->env, symb);
+  compiler->heap += 8;
+  compiler->ret_type = String;
+}
+
+/// string=? and string<?, calling the runtime to compare the bytes. string=?
+/// settles the same string and strings of different counts inline.
+void emit_strcomp(compiler_t *compiler, const char *fun, int equal,
+                  exprs_t rest) {
+  if (rest.len != 2) {
+    errc(compiler, ExpectedBinary);
+    return;
+  }
+  size_t other = get_unused_env(compiler->env);
+  emit_store_expr(compiler, rest.arr[1], other, 0, 0);
+  emit_expr(compiler, rest.arr[0]);
+  size_t same = compiler->label++;
+  size_t differ = compiler->label++;
+  size_t end = compiler->label++;
+  if (equal) {
+    emit_var_str(compiler, "cmpq %s, %%rax", other);
+    emit_size_str(compiler, "je L%zu", same);
+    emit_movq_var_reg(compiler, other, R14);
+    emit_str(compiler, "movq 5(%r14), %r14\ncmpq 5(%rax), %r14");
+    emit_size_str(compiler, "jne L%zu", differ);
+  }
+  size_t base = spill_args(compiler, 0);
+  emit_movq_var_reg(compiler, other, Rsi);
+  emit_str(compiler, "movq %rax, %rdi");
+  emit_mal_sprintf("callq %s", args(fun));
+  reorganize_args(compiler, base);
+  remove_env(compiler->env, other);
+  if (equal) {
+    emit_size_str(compiler, "jmp L%zu", end);
+    emit_size_str(compiler, "L%zu:", same);
+    emit_str(compiler, "movl $159, %eax");
+    emit_size_str(compiler, "jmp L%zu", end);
+    emit_size_str(compiler, "L%zu:", differ);
+    emit_str(compiler, "movl $31, %eax");
+    emit_size_str(compiler, "L%zu:", end);
+  }
+  compiler->ret_type = Boolean;
+}
+
+void emit_strhash(compiler_t *compiler, exprs_t rest) {
+  if (rest.len != 1) {
+    errc(compiler, ExpectedUnary);
+    return;
+  }
+  emit_expr(compiler, rest.arr[0]);
+  size_t base = spill_args(compiler, 0);
+  emit_str(compiler, "movq %rax, %rdi\ncallq string_hash");
+  reorganize_args(compiler, base);
+  compiler->ret_type = Fixnum;
+}
+
 void emit_cdrset(compiler_t *compiler, exprs_t rest) {
   if (rest.len == 2) {
     size_t obj = get_unused_env(compiler->env);
     emit_store_expr(compiler, rest.arr[1], obj, 0, 0);
     emit_expr(compiler, rest.arr[0]);
-    emit_movq_reg_regmem(compiler, obj, 7, Rax);
+    emit_movq_var_regmem(compiler, obj, 15, Rax);
+    size_t slot = get_unused_env(compiler->env);
+    emit_str(compiler, "leaq 15(%rax), %r14");
+    emit_movq_reg_var(compiler, R14, slot);
+    emit_barrier(compiler, obj, slot);
     remove_env(compiler->env, obj);
+    remove_env(compiler->env, slot);
   } else {
     compiler->line = rest.arr[0].line;
     compiler->loc = rest.arr[0].loc;
@@ -1598,8 +2209,13 @@ void emit_carset(compiler_t *compiler, exprs_t rest) {
     size_t obj = get_unused_env(compiler->env);
     emit_store_expr(compiler, rest.arr[1], obj, 0, 0);
     emit_expr(compiler, rest.arr[0]);
-    emit_movq_reg_regmem(compiler, obj, -1, Rax);
+    emit_movq_var_regmem(compiler, obj, 7, Rax);
+    size_t slot = get_unused_env(compiler->env);
+    emit_str(compiler, "leaq 7(%rax), %r14");
+    emit_movq_reg_var(compiler, R14, slot);
+    emit_barrier(compiler, obj, slot);
     remove_env(compiler->env, obj);
+    remove_env(compiler->env, slot);
   } else {
     compiler->line = rest.arr[0].line;
     compiler->loc = rest.arr[0].loc;
@@ -1621,6 +2237,11 @@ void emit_set(compiler_t *compiler, exprs_t rest) {
       emit_movq_regmem_var(
           compiler, compiler->env->arr[found].free_idx * 8 + 10, R13, tmp);
       emit_movq_reg_regmem(compiler, Rax, 0, tmp + 1);
+      // The box is referenced by the address of its slot
+      size_t val = get_unused_env(compiler->env);
+      emit_movq_reg_var(compiler, Rax, val);
+      emit_barrier(compiler, val, tmp);
+      remove_env(compiler->env, val);
       remove_env(compiler->env, tmp);
       compiler->env->arr[found].val_type = compiler->ret_type += BoxUnknown;
       break;
@@ -1656,86 +2277,223 @@ void emit_set(compiler_t *compiler, exprs_t rest) {
   }
 }
 
-void solve_call_order(compiler_t *compiler, exprs_t args, exprs_t rest) {
-  bitmat_t *bitmat = create_bitmat(rest.len, args.len);
-  size_t *order = calloc(rest.len, sizeof(*order));
-  // Setup
+/// Exchange two registers, going through rax if either is on the stack
+void emit_xchgq_var_var(compiler_t *compiler, size_t var1, size_t var2) {
+  if (var1 >= compiler->env->stack_offset ||
+      var2 >= compiler->env->stack_offset) {
+    emit_movq_var_reg(compiler, var1, Rax);
+    emit_movq_var_var(compiler, var2, var1);
+    emit_movq_reg_var(compiler, Rax, var2);
+  } else {
+    emit_genins_reg_reg(compiler, "xchgq", reg_to_str, var1 + 1, var2 + 1);
+  }
+}
+
+/// Sequentializes the parallel move of srcs[i] into register i.
+///
+/// A move is emitted once no other pending move reads its destination. When
+/// none can be emitted, what is left are cycles, and one xchgq places a value
+/// while rotating the rest of its cycle. Each register is therefore written
+/// once, and a cycle of k costs k - 1 exchanges.
+/// @param srcs Source register for each argument, -1 if it has none.
+void emit_parallel_move(compiler_t *compiler, ssize_t *srcs, size_t len) {
+  size_t ncol = compiler->env->rlen > len ? compiler->env->rlen : len;
+  bitmat_t *reads = create_bitmat(len, ncol);
+  size_t pending = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (srcs[i] != -1 && srcs[i] != (ssize_t)i) {
+      set_bitmat(reads, i, srcs[i], 1);
+      pending++;
+    }
+  }
+  while (pending) {
+    int progress = 0;
+    for (size_t i = 0; i < len; i++) {
+      if (srcs[i] != -1 && srcs[i] != (ssize_t)i &&
+          find_col_bitmat(reads, i) == -1) {
+        emit_movq_var_var(compiler, srcs[i], i);
+        clear_row_bitmat(reads, i);
+        srcs[i] = i;
+        pending--;
+        progress = 1;
+      }
+    }
+    if (!progress) {
+      size_t i = 0;
+      while (srcs[i] == -1 || srcs[i] == (ssize_t)i) {
+        i++;
+      }
+      // i now holds its value while srcs[i] holds the old i
+      size_t src = srcs[i];
+      emit_xchgq_var_var(compiler, src, i);
+      clear_row_bitmat(reads, i);
+      srcs[i] = i;
+      pending--;
+      for (ssize_t j; (j = find_col_bitmat(reads, i)) != -1;) {
+        flip_bitmat(reads, j, i);
+        flip_bitmat(reads, j, src);
+        srcs[j] = src;
+        if (src == (size_t)j) {
+          clear_row_bitmat(reads, j);
+          pending--;
+        }
+      }
+    }
+  }
+  delete_bitmat(reads);
+}
+
+/// Whether an argument is only a mov of an immediate, thus can be left last
+int is_imm_arg(compiler_t *compiler, expr_t expr) {
+  if (expr.type == Symb) {
+    ssize_t found = rfind_active_var_env(compiler->env, expr.str);
+    return found != -1 && compiler->env->arr[found].var_type == Constant;
+  }
+  return expr.type == Null || expr.type == Num || expr.type == Chr ||
+         expr.type == UniChr || expr.type == Bool;
+}
+
+/// Finds the variable an argument can be moved from without emitting it
+/// @return Index of the variable, -1 if it needs to be emitted.
+ssize_t find_move_arg(compiler_t *compiler, expr_t expr) {
+  if (expr.type != Symb) {
+    return -1;
+  }
+  ssize_t found = rfind_active_var_env(compiler->env, expr.str);
+  if (found == -1 || compiler->env->arr[found].var_type != Mutable ||
+      compiler->env->arr[found].val_type >= BoxUnknown ||
+      compiler->env->arr[found].idx == -1) {
+    return -1;
+  }
+  return found;
+}
+
+/// Places the call arguments into registers 0..n-1.
+///
+/// Arguments that need computation are emitted first into temporaries, while
+/// the current registers are all intact. Then variables and temporaries are
+/// shuffled in with a parallel move, and immediates are written last.
+/// @param closure Register to load into r13 once the arguments no longer need
+/// the current closure, -1 to keep it.
+void solve_call_order(compiler_t *compiler, exprs_t rest, ssize_t closure) {
+  ssize_t *srcs = malloc(sizeof(*srcs) * rest.len);
+  ssize_t *vars = malloc(sizeof(*vars) * rest.len);
+  enum val_type *types = malloc(sizeof(*types) * rest.len);
   for (size_t i = 0; i < rest.len; i++) {
-    order[i] = i;
-    for (size_t j = 0; j < args.len; j++) {
-      set_bitmat(bitmat, j, i, check_symb_expr(rest.arr[j], args.arr[i].str));
+    srcs[i] = -1;
+    vars[i] = -1;
+    if (is_imm_arg(compiler, rest.arr[i])) {
+      continue;
+    }
+    vars[i] = find_move_arg(compiler, rest.arr[i]);
+    if (vars[i] != -1) {
+      srcs[i] = compiler->env->arr[vars[i]].idx;
+      types[i] = compiler->env->arr[vars[i]].val_type;
+    } else {
+      srcs[i] = get_unused_env(compiler->env);
+      emit_store_expr(compiler, rest.arr[i], srcs[i], 0, 0);
+      types[i] = compiler->env->rarr[srcs[i]].type;
     }
   }
-  // Reorganize to Solve
+  if (closure != -1) {
+    emit_movq_var_reg(compiler, closure, R13);
+  }
+  ssize_t *temps = malloc(sizeof(*temps) * rest.len);
+  for (size_t i = 0; i < rest.len; i++) {
+    temps[i] = vars[i] == -1 ? srcs[i] : -1;
+  }
+  emit_parallel_move(compiler, srcs, rest.len);
   for (size_t i = 0; i < rest.len; i++) {
-    size_t res = is_ef_pivot_col_bitmat(bitmat, order[i], i);
-    if (res) {
-      swap_row_bitmat(bitmat, order[i], order[res]);
-      size_t tmp = order[i];
-      order[i] = order[res];
-      order[res] = tmp;
+    if (temps[i] >= (ssize_t)rest.len) {
+      remove_env(compiler->env, temps[i]);
     }
   }
-  // Resolve and Reap
   for (size_t i = 0; i < rest.len; i++) {
-    if (is_row_unique_bitmat(bitmat, order[i])) {
-      size_t new = reassign_postn_env(compiler->env, order[i], rest.len);
-      emit_movq_var_var(compiler, order[i], new);
+    if (srcs[i] == -1) {
+      emit_store_expr(compiler, rest.arr[i], i, 0, 0);
+    } else {
+      compiler->env->rarr[i].type = types[i];
     }
-    emit_store_expr(compiler, rest.arr[order[i]], order[i], 0, 0);
   }
-  free(order);
-  delete_bitmat(bitmat);
+  free(temps);
+  free(types);
+  free(vars);
+  free(srcs);
 }
 
 void emit_closure(compiler_t *compiler, size_t lamb, size_t arity) {
   size_t boxes = 0;
+  size_t free = 0;
   for (size_t i = 0; i < compiler->env->len; i++) {
     if (compiler->env->arr[i].active) {
       if (compiler->env->arr[i].val_type >= BoxUnknown) {
         boxes++;
       }
+      if (compiler->env->arr[i].var_type == Free &&
+          compiler->env->arr[i].free_idx >= (ssize_t)free) {
+        free = compiler->env->arr[i].free_idx + 1;
+      }
     }
   }
-  collect(compiler, compiler->free * 8 + 16 + boxes * 8);
+  collect(compiler, free * 8 + 16 + boxes * 16);
+  count_alloc(compiler, OBJ_LAMB, free * 8 + 16 + boxes * 16);
   if (boxes) {
-    for (size_t i = 0, j = 0; i < compiler->env->len; i++) {
+    // Boxes are referenced by the address of their value, past the header
+    emit_size_str(compiler,
+                  "movq gen0_ptr(%%rip), %%r14\nmovabsq $%zu, %%rax",
+                  make_hdr(OBJ_BOX, 2));
+    for (size_t i = 0; i < compiler->env->len; i++) {
       if (compiler->env->arr[i].active &&
           compiler->env->arr[i].val_type >= BoxUnknown) {
-        emit_movq_var_regmem(compiler, compiler->env->arr[i].idx, j * 8, R14);
+        emit_str(compiler, "movq %rax, (%r14)");
+        emit_movq_var_regmem(compiler, compiler->env->arr[i].idx, 8, R14);
         emit_genins_imm_reg(compiler, "addq", reg_to_str, 8, R14);
         emit_movq_reg_var(compiler, R14, compiler->env->arr[i].idx);
-        j++;
+        emit_genins_imm_reg(compiler, "addq", reg_to_str, 8, R14);
       }
     }
-    emit_size_str(compiler, "addq $%zu, gen0_ptr(%rip)", boxes * 8);
+    emit_size_str(compiler, "addq $%zu, gen0_ptr(%rip)", boxes * 16);
   }
-  emit_size_str(compiler, "movq gen0_ptr(%%rip), %%r14\nmovq $%zu, (%%r14)",
-                arity);
+  emit_size_str(compiler,
+                "movq gen0_ptr(%%rip), %%r14\nmovabsq $%zu, %%rax\n"
+                "movq %%rax, (%%r14)",
+                make_hdr(OBJ_LAMB, free + 2) | arity << HDR_ARITY_SHIFT);
   size_t tmp = get_unused_env(compiler->env);
   emit_leaq_label_var(compiler, "lambda", lamb, tmp);
   emit_movq_var_regmem(compiler, tmp, 8, R14);
   remove_env(compiler->env, tmp);
-  for (size_t i = 0, j = 0; i < compiler->env->len; i++) {
+  ssize_t self = -1;
+  for (size_t i = 0; i < compiler->env->len; i++) {
     if (compiler->env->arr[i].active &&
         compiler->env->arr[i].var_type == Free &&
         compiler->env->arr[i].free_idx != -1) {
-      emit_movq_var_regmem(compiler, compiler->env->arr[i].idx, j * 8 + 16,
-                           R14);
-      j++;
+      size_t j = compiler->env->arr[i].free_idx;
+      // A define without a location yet is the lambda referring to itself
+      if (compiler->env->arr[i].idx == -1) {
+        self = j;
+      } else {
+        emit_movq_var_regmem(compiler, compiler->env->arr[i].idx, j * 8 + 16,
+                             R14);
+      }
     }
   }
   emit_str(compiler, "movq %r14, %rax\norq $6, %rax");
-  emit_size_str(compiler, "addq $%zu, gen0_ptr(%rip)", compiler->free * 8 + 16);
-  compiler->heap += compiler->free * 8 + 16 + boxes * 8;
+  if (self != -1) {
+    emit_movq_reg_regmem(compiler, Rax, self * 8 + 16, R14);
+  }
+  emit_size_str(compiler, "addq $%zu, gen0_ptr(%rip)", free * 8 + 16);
+  compiler->heap += free * 8 + 16 + boxes * 16;
 }
 
-void emit_tail_call(compiler_t *compiler, exprs_t args, exprs_t rest) {
-  solve_call_order(compiler, args, rest);
+void emit_tail_call(compiler_t *compiler, exprs_t rest) {
+  push_later(compiler, rest);
+  solve_call_order(compiler, rest, -1);
+  pop_later(compiler);
   if (compiler->env->len > compiler->env->stack_offset + 1) {
     emit_size_str(compiler, "addq $%zu, %%rsp",
                   (compiler->env->len - compiler->env->stack_offset) * 8);
   }
+  emit_size_str(compiler, "addq $frame%zu, %%rsp", compiler->frame);
   emit_str(compiler, "movq 2(%r13), %rax");
   emit_str(compiler, "jmp *%rax");
 }
@@ -1744,14 +2502,18 @@ void try_emit_tail_if(compiler_t *compiler, const char *name, exprs_t args,
                       exprs_t rest) {
   if (rest.len == 2) {
     size_t l0 = compiler->label++;
+    push_later(compiler, slice_start_exprs(&rest, 1));
     emit_expr(compiler, rest.arr[0]); // Test
+    pop_later(compiler);
     emit_size_str(compiler, "cmpq $31, %rax\nje L%zu", l0);
     try_emit_tail_call(compiler, name, args, rest.arr[1]);
     emit_size_str(compiler, "L%zu:", l0);
   } else if (rest.len == 3) {
     size_t l0 = compiler->label++;
     size_t l1 = compiler->label++;
+    push_later(compiler, slice_start_exprs(&rest, 1));
     emit_expr(compiler, rest.arr[0]); // Test
+    pop_later(compiler);
     emit_size_str(compiler, "cmpq $31, %rax\nje L%zu", l0);
     try_emit_tail_call(compiler, name, args, rest.arr[1]);
     emit_size_str(compiler, "jmp L%zu", l1);
@@ -1771,7 +2533,7 @@ void try_emit_tail_call(compiler_t *compiler, const char *name, exprs_t args,
     if (last.exprs->arr[0].type == Symb) {
       if (!strcmp(last.exprs->arr[0].str, name)) {
         if (args.len == last.exprs->len - 1) {
-          emit_tail_call(compiler, args, slice_start_exprs(last.exprs, 1));
+          emit_tail_call(compiler, slice_start_exprs(last.exprs, 1));
           return;
         } else {
           errc(compiler, ExpectedNoArg + args.len);
@@ -1812,7 +2574,11 @@ void emit_lambda(compiler_t *compiler, const char *name, exprs_t rest) {
     if (rest.arr[0].type == List) {
       enum emit saved_emit = compiler->emit;
       size_t saved_free = compiler->free;
+      size_t saved_later_base = compiler->later_base;
+      size_t saved_later_vars = compiler->later_vars;
       compiler->free = 0;
+      compiler->later_base = compiler->later_len;
+      compiler->later_vars = compiler->env->len;
       for (size_t i = 0; i < compiler->env->len; i++) {
         if (compiler->env->arr[i].var_type == Mutable) {
           compiler->env->arr[i].var_type = Free;
@@ -1841,35 +2607,64 @@ void emit_lambda(compiler_t *compiler, const char *name, exprs_t rest) {
       emit_size_str(compiler, "lambda%zu:", compiler->lambda);
       size_t lamb = compiler->lambda;
       compiler->lambda++;
+      size_t saved_frame = compiler->frame;
+      size_t saved_spill_slots = compiler->spill_slots;
+      size_t saved_spill_max = compiler->spill_max;
+      compiler->frame = lamb;
+      compiler->spill_slots = 0;
+      compiler->spill_max = 0;
 
       lock_dstrs(compiler->fun);
       find_and_fill_boxes(compiler, rest);
       if (name && rest.len > 1) {
         for (size_t i = 1; i < rest.len - 1; i++) {
+          push_later(compiler, slice_start_exprs(&rest, i + 1));
           emit_expr(compiler, rest.arr[i]);
+          pop_later(compiler);
         }
         try_emit_tail_call(compiler, name, *rest.arr[0].exprs,
                            rest.arr[rest.len - 1]);
       } else {
         for (size_t i = 1; i < rest.len; i++) {
+          push_later(compiler, slice_start_exprs(&rest, i + 1));
           emit_expr(compiler, rest.arr[i]);
+          pop_later(compiler);
         }
       }
       if (compiler->env->len > compiler->env->stack_offset) {
         emit_size_str(compiler, "addq $%zu, %%rsp",
                       (compiler->env->len - compiler->env->stack_offset) * 8);
       }
+      if (compiler->spill_max) {
+        emit_size_str(compiler, "addq $frame%zu, %%rsp", lamb);
+      }
       emit_str(compiler, "retq");
+      // Spill slots are only known after the body, including tail calls
+      emit_mal_sprintf(".equ frame%zu, %zu",
+                       args(lamb, (compiler->spill_max * 8 + 15) & ~15UL));
       unlock_dstrs(compiler->fun);
       if (compiler->env->len > compiler->env->stack_offset + 1) {
         emit_size_str(compiler, "subq $%zu, %%rsp",
                       (compiler->env->len - compiler->env->stack_offset) * 8);
       }
+      if (compiler->spill_max) {
+        emit_size_str(compiler, "subq $frame%zu, %%rsp", lamb);
+      }
       unlock_dstrs(compiler->fun);
       compiler->emit = saved_emit;
       compiler->free = saved_free;
+      compiler->later_base = saved_later_base;
+      compiler->later_vars = saved_later_vars;
+      compiler->frame = saved_frame;
+      compiler->spill_slots = saved_spill_slots;
+      compiler->spill_max = saved_spill_max;
 
+      // Counted at the line of the lambda, not of the end of its body
+      compiler->line = rest.arr[0].line;
+      // The captured variables are read once the closure is allocated
+      push_later(compiler, rest);
       emit_closure(compiler, lamb, rest.arr[0].exprs->len);
+      pop_later(compiler);
       compiler->ret_type = Lambda;
       if (rest.arr[0].exprs) {
         compiler->ret_args = clone_exprs(rest.arr[0].exprs);
@@ -1945,7 +2740,10 @@ void emit_define(compiler_t *compiler, exprs_t rest) {
 
       exprs_t *tmp = create_exprs(2);
       exprs_t slice = slice_start_exprs(rest.arr[0].exprs, 1);
-      push_exprs(tmp, (expr_t){.type = List, .exprs = &slice});
+      push_exprs(tmp, (expr_t){.type = List,
+                               .exprs = &slice,
+                               .line = rest.arr[0].line,
+                               .loc = rest.arr[0].loc});
       for (size_t i = 1; i < rest.len; i++) {
         push_exprs(tmp, clone_expr(rest.arr[i]));
       }
@@ -1974,66 +2772,70 @@ void emit_define(compiler_t *compiler, exprs_t rest) {
   }
 }
 
+/// Calls the closure in `callee`, checking its arity at runtime if asked to
+void emit_call(compiler_t *compiler, expr_t callee, exprs_t rest, int check) {
+  size_t c_base = spill_closure(compiler);
+  size_t a_base = spill_args(compiler, rest.len);
+  size_t closure = get_unused_env(compiler->env);
+  // Only the arguments are read after what they compute, not the call
+  push_later(compiler, rest);
+  emit_store_expr(compiler, callee, closure, 0, 0);
+  solve_call_order(compiler, rest, closure);
+  pop_later(compiler);
+  if (closure >= rest.len) {
+    remove_env(compiler->env, closure);
+  }
+  size_t l0 = compiler->label++;
+  if (check) {
+    emit_size_str(compiler, "cmpl $%zu, -6(%%r13)",
+                  rest.len << HDR_ARITY_SHIFT | OBJ_LAMB);
+    emit_size_str(compiler, "jne L%zu", l0);
+  }
+  emit_str(compiler, "movq 2(%r13), %rax");
+  emit_str(compiler, "callq *%rax");
+  if (check) {
+    emit_size_str(compiler, "L%zu:", l0);
+  }
+  reorganize_args(compiler, a_base);
+  reorganize_args(compiler, c_base);
+  compiler->ret_type = Unknown;
+}
+
 void emit_ufun(compiler_t *compiler, const char *str, exprs_t rest) {
   ssize_t found = rfind_active_var_env(compiler->env, str);
   if (found != -1) {
-    if (compiler->env->arr[found].val_type == Lambda) {
-      if (compiler->emit == Fun) {
-        if (compiler->env->arr[found].var_type == Free) {
-          // NOTE: This is the worst case. Gates have fallen.
-          // We cannot tell if we are looking at a lamb or a number.
-          size_t l0 = compiler->label++;
-          emit_size_str(compiler, "movq %zu(%%r13), %%rax", found * 8 + 10);
-          emit_str(compiler, "pushq %r13\nmovq %rax, %r13");
-          emit_str(compiler, "movq -6(%r13), %rax");
-          emit_size_str(compiler, "cmpq $%zu, %%rax", rest.len);
-          emit_size_str(compiler, "jne L%zu", l0);
-          size_t a_count = spill_args(compiler);
-          // TODO: Try to order this if possible at all, since otherwise (f
-          // (n-1) n) will always cause unexpected behaviour. Worst case have to
-          // reassign and save all variables to guarantee proper result.
-          for (size_t i = 0; i < rest.len; i++) {
-            size_t new = reassign_postn_env(compiler->env, i, rest.len);
-            emit_movq_reg_reg(compiler, i + 1, new + 1);
-            emit_store_expr(compiler, rest.arr[i], i, 0, 0);
-          }
-          emit_str(compiler, "movq 2(%r13), %rax");
-          emit_str(compiler, "callq *%rax");
-          reorganize_args(compiler, a_count);
-          emit_size_str(compiler, "L%zu:", l0);
-          emit_str(compiler, "popq %r13");
-        }
-      } else {
-        emit_str(compiler, "pushq %r13");
-        emit_movq_var_reg(compiler, compiler->env->arr[found].idx, R13);
-        size_t a_count = spill_args(compiler);
-        solve_call_order(compiler, *compiler->env->arr[found].args, rest);
-        emit_str(compiler, "movq 2(%r13), %rax");
-        emit_str(compiler, "callq *%rax");
-        reorganize_args(compiler, a_count);
-        emit_str(compiler, "popq %r13");
-      }
-    } else {
-      if (compiler->env->arr[found].args->len == rest.len) {
-        if (compiler->env->arr[found].idx != -1 &&
-            compiler->env->arr[found].idx + 1 != R13) {
-          emit_movq_var_reg(compiler, compiler->env->arr[found].idx, R13);
-        }
-        size_t a_count = spill_args(compiler);
-        solve_call_order(compiler, *compiler->env->arr[found].args, rest);
-        emit_str(compiler, "movq 2(%r13), %rax");
-        emit_str(compiler, "callq *%rax");
-        reorganize_args(compiler, a_count);
-      } else {
-        errc(compiler, ExpectedNoArg + compiler->env->arr[found].args->len);
-      }
+    exprs_t *args = compiler->env->arr[found].args;
+    if (args && args->len != rest.len) {
+      errc(compiler, ExpectedNoArg + args->len);
+      return;
     }
+    // NOTE: A free lambda can be rebound at runtime, so its arity is checked
+    expr_t callee = {.type = Symb,
+                     .str = (char *)str,
+                     .line = compiler->line,
+                     .loc = compiler->loc};
+    emit_call(compiler, callee, rest,
+              !args || compiler->env->arr[found].var_type == Free);
   } else {
     errc(compiler, UnmatchedFun);
   }
 }
 
+/// Whether a form orders the evaluation of its parts itself, pushing what runs
+/// after each of them
+int is_ordered_form(const char *str) {
+  return !strcmp(str, "begin") || !strcmp(str, "define") ||
+         !strcmp(str, "if") || !strcmp(str, "lambda") || !strcmp(str, "let") ||
+         !strcmp(str, "let*");
+}
+
 void emit_function(compiler_t *compiler, expr_t first, exprs_t rest) {
+  // Other built in forms may read any operand after computing another one
+  int pushed = first.type == Symb && !is_ordered_form(first.str);
+  if (pushed) {
+    push_later(compiler, rest);
+  }
+  push_doing(compiler, rest.arr);
   switch (first.type) {
   case Symb:
     switch (first.str[0]) {
@@ -2063,16 +2865,14 @@ void emit_function(compiler_t *compiler, expr_t first, exprs_t rest) {
       break;
     case '*':
       if (!strcmp(first.str, "*")) {
-        // Deal with the Devil
-        emit_binary(compiler, "shr $2, %%rax\nimulq %s, %%rax", rest);
+        emit_mul(compiler, rest);
         compiler->ret_type = Unknown;
       } else
         goto Unmatched;
       break;
     case '/':
       if (!strcmp(first.str, "/")) {
-        // Deal with the Devil
-        emit_binary(compiler, "cqto\nidivq %s, %%rax\nshl $2, %%rax", rest);
+        emit_div(compiler, rest);
         compiler->ret_type = Unknown;
       } else
         goto Unmatched;
@@ -2137,26 +2937,26 @@ void emit_function(compiler_t *compiler, expr_t first, exprs_t rest) {
         emit_cons(compiler, rest);
         compiler->ret_type = Cons;
       } else if (!strcmp(first.str, "car")) {
-        emit_unary(compiler, "movq -1(%rax), %rax", rest);
+        emit_unary(compiler, "movq 7(%rax), %rax", rest);
         compiler->ret_type = Unknown;
       } else if (!strcmp(first.str, "cdr")) {
-        emit_unary(compiler, "movq 7(%rax), %rax", rest);
+        emit_unary(compiler, "movq 15(%rax), %rax", rest);
         compiler->ret_type = Unknown;
       } else if (!strcmp(first.str, "caar")) {
-        emit_unary(compiler, "movq -1(%rax), %rax", rest);
-        emit_str(compiler, "movq -1(%rax), %rax");
+        emit_unary(compiler, "movq 7(%rax), %rax", rest);
+        emit_str(compiler, "movq 7(%rax), %rax");
         compiler->ret_type = Unknown;
       } else if (!strcmp(first.str, "cadr")) {
-        emit_unary(compiler, "movq 7(%rax), %rax", rest);
-        emit_str(compiler, "movq -1(%rax), %rax");
+        emit_unary(compiler, "movq 15(%rax), %rax", rest);
+        emit_str(compiler, "movq 7(%rax), %rax");
         compiler->ret_type = Unknown;
       } else if (!strcmp(first.str, "cdar")) {
-        emit_unary(compiler, "movq -1(%rax), %rax", rest);
-        emit_str(compiler, "movq 7(%rax), %rax");
+        emit_unary(compiler, "movq 7(%rax), %rax", rest);
+        emit_str(compiler, "movq 15(%rax), %rax");
         compiler->ret_type = Unknown;
       } else if (!strcmp(first.str, "cddr")) {
-        emit_unary(compiler, "movq 7(%rax), %rax", rest);
-        emit_str(compiler, "movq 7(%rax), %rax");
+        emit_unary(compiler, "movq 15(%rax), %rax", rest);
+        emit_str(compiler, "movq 15(%rax), %rax");
         compiler->ret_type = Unknown;
       } else
         goto Unmatched;
@@ -2171,6 +2971,12 @@ void emit_function(compiler_t *compiler, expr_t first, exprs_t rest) {
       if (!strcmp(first.str, "exit")) {
         emit_str(compiler, "movq $0, %rdi\nmovq $60, %rax\nsyscall");
         compiler->ret_type = None;
+      } else if (!strcmp(first.str, "eq?")) {
+        emit_comp(compiler,
+                  "cmpq %s, %%rax\nmovl $0, %%eax\nsete %%al\nshll $7, "
+                  "%%eax\norl $31, %%eax",
+                  rest);
+        compiler->ret_type = Boolean;
       } else
         goto Unmatched;
       break;
@@ -2192,7 +2998,6 @@ void emit_function(compiler_t *compiler, expr_t first, exprs_t rest) {
         compiler->ret_type = None;
       } else if (!strcmp(first.str, "string")) {
         emit_string(compiler, rest);
-        compiler->ret_type = Vector;
       } else if (!strcmp(first.str, "string?")) {
         emit_quest(compiler, "andl $7, %eax", 3, rest);
         compiler->ret_type = Boolean;
@@ -2204,6 +3009,37 @@ void emit_function(compiler_t *compiler, expr_t first, exprs_t rest) {
       } else if (!strcmp(first.str, "string-set!")) {
         emit_strset(compiler, rest);
         compiler->ret_type = None;
+      } else if (!strcmp(first.str, "string-append")) {
+        emit_strappend(compiler, rest);
+      } else if (!strcmp(first.str, "substring")) {
+        emit_strbulk(compiler, "string_copy", rest, 3, 3);
+      } else if (!strcmp(first.str, "string-copy")) {
+        emit_strbulk(compiler, "string_copy", rest, 1, 3);
+      } else if (!strcmp(first.str, "string-copy!")) {
+        emit_strbulk(compiler, "string_copy_into", rest, 3, 5);
+        compiler->ret_type = None;
+      } else if (!strcmp(first.str, "string-fill!")) {
+        emit_strbulk(compiler, "string_fill", rest, 2, 4);
+        compiler->ret_type = None;
+      } else if (!strcmp(first.str, "string=?")) {
+        emit_strcomp(compiler, "string_equal", 1, rest);
+      } else if (!strcmp(first.str, "string<?")) {
+        emit_strcomp(compiler, "string_less", 0, rest);
+      } else if (!strcmp(first.str, "string-hash")) {
+        emit_strhash(compiler, rest);
+      } else if (!strcmp(first.str, "string->symbol")) {
+        emit_strsymb(compiler, rest);
+      } else if (!strcmp(first.str, "symbol?")) {
+        emit_quest(compiler, "andl $7, %eax", 5, rest);
+        compiler->ret_type = Boolean;
+      } else if (!strcmp(first.str, "symbol->string")) {
+        emit_symbstr(compiler, rest);
+      } else
+        goto Unmatched;
+      break;
+    case 'q':
+      if (!strcmp(first.str, "quote")) {
+        emit_quote(compiler, rest);
       } else
         goto Unmatched;
       break;
@@ -2265,7 +3101,11 @@ void emit_function(compiler_t *compiler, expr_t first, exprs_t rest) {
         emit_quest(compiler, "andl $7, %eax", 2, rest);
         compiler->ret_type = Boolean;
       } else if (!strcmp(first.str, "vector-length")) {
-        emit_unary(compiler, "movq -2(%rax), %rax", rest);
+        // Words less the header's, as a fixnum
+        emit_unary(compiler,
+                   "movq -2(%rax), %rax\nshrq $32, %rax\n"
+                   "leaq -4(,%rax,4), %rax",
+                   rest);
         compiler->ret_type = Fixnum;
       } else if (!strcmp(first.str, "vector-ref")) {
         emit_vecref(compiler, rest);
@@ -2285,37 +3125,25 @@ void emit_function(compiler_t *compiler, expr_t first, exprs_t rest) {
       break;
     default:
     Unmatched:
+      // A call saves what is read after it before reading its arguments
+      if (pushed) {
+        pop_later(compiler);
+        pushed = 0;
+      }
       emit_ufun(compiler, first.str, rest);
     }
     break;
   case List:
-    emit_function(compiler, first.exprs->arr[0],
-                  slice_start_exprs(first.exprs, 1));
-    if (compiler->ret_type != Lambda) {
-      errc(compiler, ExpectedFunSymb);
-    }
-    size_t l0 = compiler->label++;
-    emit_str(compiler, "movq %rax, %r13");
-    emit_str(compiler, "movq -6(%r13), %rax");
-    emit_size_str(compiler, "cmpq $%zu, %%rax", rest.len);
-    emit_size_str(compiler, "jne L%zu", l0);
-    size_t a_count = spill_args(compiler);
-    for (size_t i = 0; i < rest.len; i++) {
-      emit_store_expr(compiler, rest.arr[i], i, 0, 0);
-      compiler->env->arr[i].val_type = Unknown;
-    }
-    for (size_t i = 0; i < rest.len; i++) {
-      compiler->env->arr[i].val_type = None;
-    }
-    emit_str(compiler, "movq 2(%r13), %rax");
-    emit_str(compiler, "callq *%rax");
-    reorganize_args(compiler, a_count);
-    emit_size_str(compiler, "L%zu:", l0);
+    emit_call(compiler, first, rest, 1);
     break;
   default:
     errc(compiler, ExpectedFunSymb);
     break;
   }
+  if (pushed) {
+    pop_later(compiler);
+  }
+  compiler->doing_len--;
 }
 
 void emit_store_symb_expr(compiler_t *compiler, const char *symb, size_t index,
@@ -2485,104 +3313,341 @@ void emit_exprs(compiler_t *compiler) {
   for (size_t i = 0; i < compiler->input->len; i++) {
     compiler->line = compiler->input->arr[i].line;
     compiler->loc = compiler->input->arr[i].loc;
+    push_later(compiler, slice_start_exprs(compiler->input, i + 1));
     emit_expr(compiler, compiler->input->arr[i]);
+    pop_later(compiler);
+  }
+}
+
+void push_later(compiler_t *compiler, exprs_t exprs) {
+  if (compiler->later_len >= compiler->later_cap) {
+    compiler->later_cap <<= 1;
+    compiler->later = reallocarray(compiler->later, compiler->later_cap,
+                                   sizeof(*compiler->later));
+    if (!compiler->later) {
+      err(1, "Failed to allocate memory for liveness in compiler");
+    }
+  }
+  compiler->later[compiler->later_len++] = exprs;
+}
+
+void pop_later(compiler_t *compiler) { compiler->later_len--; }
+
+void push_doing(compiler_t *compiler, expr_t *operands) {
+  if (compiler->doing_len >= compiler->doing_cap) {
+    compiler->doing_cap <<= 1;
+    compiler->doing = reallocarray(compiler->doing, compiler->doing_cap,
+                                   sizeof(*compiler->doing));
+    if (!compiler->doing) {
+      err(1, "Failed to allocate memory for liveness in compiler");
+    }
+  }
+  compiler->doing[compiler->doing_len++] = operands;
+}
+
+/// Whether the form with these operands is being emitted
+int is_doing(compiler_t *compiler, expr_t *operands) {
+  for (size_t i = compiler->doing_len; i > 0; i--) {
+    if (compiler->doing[i - 1] == operands) {
+      return 1;
+    }
   }
+  return 0;
+}
+
+/// Whether `symb` appears in `exprs`, nested lambdas and quotes included,
+/// except within the forms being emitted
+int names_symb(compiler_t *compiler, exprs_t exprs, const char *symb) {
+  for (size_t i = 0; i < exprs.len; i++) {
+    if (exprs.arr[i].type == Symb) {
+      if (!strcmp(exprs.arr[i].str, symb)) {
+        return 1;
+      }
+    } else if (exprs.arr[i].type == List && exprs.arr[i].exprs->len &&
+               is_doing(compiler, exprs.arr[i].exprs->arr + 1)) {
+      continue;
+    } else if (exprs.arr[i].type == List || exprs.arr[i].type == Vec) {
+      if (names_symb(compiler, *exprs.arr[i].exprs, symb)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
 }
 
-/// Moves pointers into the root stack for the gc
+/// Whether a register may still be read after the current point.
+///
+/// Temporaries always are, and so are the variables of the top level, which
+/// root the exit snapshot. Within a lambda, a variable is once the code left
+/// to run in it names it, which includes the lambdas that capture it.
+/// Variables of the enclosing functions are read through the closure instead,
+/// and boxes and constants are kept whatever reads them.
+int is_live_env(compiler_t *compiler, size_t i) {
+  if (!compiler->env->rarr[i].type) {
+    return 0;
+  } else if (!compiler->env->rarr[i].variable || compiler->emit != Fun) {
+    return 1;
+  }
+  int bound = 0;
+  for (size_t j = 0; j < compiler->env->len; j++) {
+    var_t *var = &compiler->env->arr[j];
+    if (!var->active || var->idx != (ssize_t)i) {
+      continue;
+    } else if (var->var_type == Constant || var->val_type >= BoxUnknown) {
+      return 1;
+    }
+    bound = 1;
+    if (j < compiler->later_vars) {
+      continue;
+    }
+    for (size_t k = compiler->later_base; k < compiler->later_len; k++) {
+      if (names_symb(compiler, compiler->later[k], var->str)) {
+        return 1;
+      }
+    }
+  }
+  return !bound;
+}
+
+/// Whether a register of this type can hold a heap pointer
+int is_pointer_type(enum val_type type) {
+  return type == Unknown || type >= Cons;
+}
+
+/// Moves every live register that may hold a pointer into the root stack for
+/// the gc.
+///
+/// The closure of a lambda lives in the heap as well, so it goes last.
 size_t spill_pointers(compiler_t *compiler) {
   size_t count = 0;
   for (size_t i = 0; i < compiler->env->rlen; i++) {
-    if (compiler->env->rarr[i].type >= Cons) {
+    if (is_pointer_type(compiler->env->rarr[i].type) &&
+        is_live_env(compiler, i)) {
       compiler->env->rarr[i].root_spill = 1;
-      emit_movq_var_regmem(compiler, i, 0, R15);
-      emit_str(compiler, "addq $8, %r15");
+      emit_movq_var_regmem(compiler, i, count * 8, R15);
       count++;
     }
   }
+  if (compiler->emit == Fun) {
+    emit_movq_reg_regmem(compiler, R13, count * 8, R15);
+    count++;
+  }
+  if (count) {
+    emit_size_str(compiler, "addq $%zu, %%r15", count * 8);
+  }
   return count;
 }
 
+/// Reloads the pointers the gc may have moved, and pops them
 void reorganize_pointers(compiler_t *compiler, size_t count) {
-  emit_str(compiler, "movq rs_begin(%rip), %r15");
-  for (size_t i = 0, j = 0; i < compiler->env->rlen && j < count; i++) {
+  if (!count) {
+    return;
+  }
+  emit_size_str(compiler, "subq $%zu, %%r15", count * 8);
+  size_t j = 0;
+  for (size_t i = 0; i < compiler->env->rlen && j < count; i++) {
     if (compiler->env->rarr[i].root_spill) {
       compiler->env->rarr[i].root_spill = 0;
       emit_movq_regmem_var(compiler, j * 8, R15, i);
       j++;
     }
   }
+  if (compiler->emit == Fun) {
+    emit_movq_regmem_reg(compiler, j * 8, R15, R13);
+  }
 }
 
-/// NOTE: 6 is a magic number indicating when volatile passed arguments end
-size_t spill_args(compiler_t *compiler) {
-  size_t spilled = 0;
-  for (size_t i = 0; i < 6 && i < compiler->env->rlen; i++) {
-    if (compiler->env->rarr[i].type && !compiler->env->rarr[i].root_spill) {
-      compiler->env->rarr[i].arg_spill = compiler->env->rarr[i].type;
-      emit_var_str(compiler, "pushq %s", i);
-      spilled++;
+void push_spills(compiler_t *compiler, spill_t spill) {
+  if (compiler->spill_len >= compiler->spill_cap) {
+    compiler->spill_cap <<= 1;
+    compiler->spills = reallocarray(compiler->spills, compiler->spill_cap,
+                                    sizeof(*compiler->spills));
+    if (!compiler->spills) {
+      err(1, "Failed to allocate memory for spills in compiler");
     }
   }
-  return spilled;
+  compiler->spills[compiler->spill_len++] = spill;
 }
 
-void reorganize_args(compiler_t *compiler, size_t count) {
-  for (size_t i = compiler->env->rlen, j = 0; j < count && i > 0; i--) {
-    if (compiler->env->rarr[i - 1].arg_spill) {
-      compiler->env->rarr[i - 1].type = compiler->env->rarr[i - 1].arg_spill;
-      compiler->env->rarr[i - 1].arg_spill = 0;
-      emit_var_str(compiler, "popq %s", i - 1);
-      j++;
+/// Every register below the reserved ones is clobbered by a call, since
+/// lambdas use them freely. Only the live ones are stored, into frame slots
+/// preallocated by the function prologue. Those that may be pointers go on
+/// the root stack instead, where a collection within the call can update them.
+/// Argument registers are recorded to get their type back afterwards, or to be
+/// released if they were free.
+size_t spill_args(compiler_t *compiler, size_t arity) {
+  size_t base = compiler->spill_len;
+  for (size_t i = 0;
+       i < compiler->env->reserved_offset && i < compiler->env->rlen; i++) {
+    if (compiler->env->rarr[i].root_spill) {
+      continue;
+    } else if (!is_live_env(compiler, i)) {
+      if (i < arity) {
+        push_spills(compiler, (spill_t){.reg = i,
+                                        .slot = -1,
+                                        .type = compiler->env->rarr[i].type});
+      }
+    } else if (is_pointer_type(compiler->env->rarr[i].type)) {
+      push_spills(compiler, (spill_t){.reg = i,
+                                      .slot = -1,
+                                      .type = compiler->env->rarr[i].type,
+                                      .root = 1});
+      emit_movq_reg_regmem(compiler, i + 1, 0, R15);
+      emit_str(compiler, "addq $8, %r15");
+    } else {
+      push_spills(compiler, (spill_t){.reg = i,
+                                      .slot = compiler->spill_slots,
+                                      .type = compiler->env->rarr[i].type});
+      emit_movq_reg_regmem(compiler, i + 1, compiler->spill_slots * 8, Rsp);
+      compiler->spill_slots++;
+    }
+  }
+  if (compiler->spill_slots > compiler->spill_max) {
+    compiler->spill_max = compiler->spill_slots;
+  }
+  return base;
+}
+
+/// Stores the closure register into the root stack, restored by
+/// reorganize_args. Outside of lambdas there is no closure to keep.
+size_t spill_closure(compiler_t *compiler) {
+  size_t base = compiler->spill_len;
+  if (compiler->emit == Fun) {
+    push_spills(compiler,
+                (spill_t){.reg = R13 - 1, .slot = -1, .type = None, .root = 1});
+    emit_movq_reg_regmem(compiler, R13, 0, R15);
+    emit_str(compiler, "addq $8, %r15");
+  }
+  return base;
+}
+
+void reorganize_args(compiler_t *compiler, size_t base) {
+  while (compiler->spill_len > base) {
+    spill_t spill = compiler->spills[--compiler->spill_len];
+    if (spill.root) {
+      emit_str(compiler, "subq $8, %r15");
+      emit_movq_regmem_reg(compiler, 0, R15, spill.reg + 1);
+      if (spill.reg < compiler->env->rlen) {
+        compiler->env->rarr[spill.reg].type = spill.type;
+      }
+    } else if (spill.slot != -1) {
+      emit_movq_regmem_reg(compiler, spill.slot * 8, Rsp, spill.reg + 1);
+      compiler->env->rarr[spill.reg].type = spill.type;
+      compiler->spill_slots--;
+    } else if (spill.type) {
+      compiler->env->rarr[spill.reg].type = spill.type;
+    } else {
+      remove_env(compiler->env, spill.reg);
     }
   }
 }
 
 void collect(compiler_t *compiler, size_t request) {
   size_t p_count = spill_pointers(compiler);
-  size_t a_count = spill_args(compiler);
+  size_t a_base = spill_args(compiler, 0);
   emit_size_str(compiler, "movq %%r15, %%rdi\nmovq $%zu, %%rsi\ncallq collect",
                 request);
-  reorganize_args(compiler, a_count);
+  reorganize_args(compiler, a_base);
   reorganize_pointers(compiler, p_count);
 }
 
-void collect_retq(compiler_t *compiler, size_t extra) {
+void emit_collecting_call(compiler_t *compiler, const char *fun, size_t *vars,
+                          size_t len) {
   size_t p_count = spill_pointers(compiler);
-  size_t a_count = spill_args(compiler);
-  emit_size_str(compiler,
-                "movq %%r15, %%rdi\nleaq %zu(,%rax,2), %%rsi\ncallq collect",
-                extra);
-  reorganize_args(compiler, a_count);
+  size_t a_base = spill_args(compiler, 0);
+  // Through the free root stack, as arguments may be in each other's
+  // registers
+  for (size_t i = 0; i < len; i++) {
+    emit_movq_var_reg(compiler, vars[i], R14);
+    emit_movq_reg_regmem(compiler, R14, i * 8, R15);
+  }
+  for (size_t i = 0; i < len; i++) {
+    emit_movq_regmem_reg(compiler, i * 8, R15, Rsi + i);
+  }
+  emit_str(compiler, "movq %r15, %rdi");
+  emit_mal_sprintf("callq %s", args(fun));
+  reorganize_args(compiler, a_base);
   reorganize_pointers(compiler, p_count);
 }
-
-void collect_retb(compiler_t *compiler, size_t extra) {
+void alloc_ret(compiler_t *compiler, size_t tag) {
   size_t p_count = spill_pointers(compiler);
-  size_t a_count = spill_args(compiler);
+  size_t a_base = spill_args(compiler, 0);
   emit_size_str(compiler,
-                "movq %%r15, %%rdi\nleaq %zu(%rax), %%rsi\ncallq collect",
-                extra);
-  reorganize_args(compiler, a_count);
+                "movq %%r15, %%rdi\nmovq %%rax, %%rsi\nmovq $%zu, %%rdx\n"
+                "callq allocate\nmovq %%rax, %%r14",
+                tag);
+  reorganize_args(compiler, a_base);
   reorganize_pointers(compiler, p_count);
 }
 
+// Each site is a record of 4 words in its own data subsection, so the records
+// stay contiguous: objects, bytes, line, and object type
+size_t count_alloc(compiler_t *compiler, size_t type, size_t bytes) {
+  if (!compiler->profile) {
+    return 0;
+  }
+  size_t offset = compiler->sites++ * 32;
+  enum emit saved_emit = compiler->emit;
+  compiler->emit = Data;
+  emit_str(compiler, ".data 1");
+  if (!offset) {
+    emit_str(compiler, "alloc_sites:");
+  }
+  emit_mal_sprintf(".quad 0, 0, %zu, %zu\n.data",
+                   args(compiler->line + 1, type));
+  compiler->emit = saved_emit;
+  emit_size_str(compiler, "incq alloc_sites+%zu(%%rip)", offset);
+  if (bytes) {
+    emit_mal_sprintf("addq $%zu, alloc_sites+%zu(%%rip)",
+                     args(bytes, offset + 8));
+  } else {
+    emit_size_str(compiler, "addq %%rax, alloc_sites+%zu(%%rip)", offset + 8);
+  }
+  return compiler->sites <= SITE_MAX ? compiler->sites : 0;
+}
+
 void emit_start_end(compiler_t *compiler) {
   enum emit saved_emit = compiler->emit;
   compiler->emit = Main;
   emit_str(compiler, "main:");
+  // Registers callee saved by the ABI are used freely, and the last push
+  // keeps calls aligned
+  emit_str(compiler, "pushq %rbx\npushq %rbp\npushq %r12");
+  emit_str(compiler, "pushq %r13\npushq %r14\npushq %r15\nsubq $8, %rsp");
   if (compiler->env->len > compiler->env->stack_offset) {
     emit_genins_imm_reg(compiler, "subq", reg_to_str,
                         (compiler->env->len - compiler->env->stack_offset) * 8,
                         Rsp);
   }
+  size_t frame = (compiler->spill_max * 8 + 15) & ~15UL;
+  if (frame) {
+    emit_genins_imm_reg(compiler, "subq", reg_to_str, frame, Rsp);
+  }
   if (compiler->heap) {
     emit_movq_imm_reg(compiler, compiler->heap_size, Rdi);
     emit_movq_imm_reg(compiler, compiler->heap_size, Rsi);
     emit_str(compiler, "callq init_gc");
     emit_str(compiler, "movq rs_begin(%rip), %r15");
   }
+  if (compiler->sites) {
+    emit_str(compiler, "leaq alloc_sites(%rip), %rdi");
+    emit_movq_imm_reg(compiler, compiler->sites, Rsi);
+    emit_str(compiler, "callq init_profile");
+  }
+  if (compiler->symbs->len) {
+    emit_str(compiler, "leaq symbols(%rip), %rdi");
+    emit_movq_imm_reg(compiler, compiler->symbs->len, Rsi);
+    emit_str(compiler, "callq init_symbols");
+  }
   compiler->emit = End;
+  // The result and the variables are the roots of the exit snapshot
+  if (compiler->heap) {
+    emit_str(compiler, "movq %rax, (%r15)\naddq $8, %r15");
+    spill_pointers(compiler);
+  }
+  if (frame) {
+    emit_genins_imm_reg(compiler, "addq", reg_to_str, frame, Rsp);
+  }
   if (compiler->env->len > compiler->env->stack_offset) {
     emit_genins_imm_reg(compiler, "addq", reg_to_str,
                         (compiler->env->len - compiler->env->stack_offset) * 8,
@@ -2591,9 +3656,11 @@ void emit_start_end(compiler_t *compiler) {
   emit_str(compiler, "movq %rax, %rdi");
   emit_str(compiler, "callq print");
   if (compiler->heap) {
-    emit_str(compiler, "callq cleanup");
+    emit_str(compiler, "movq %r15, %rdi\ncallq cleanup");
   }
   emit_str(compiler, "xorl %eax, %eax");
+  emit_str(compiler, "addq $8, %rsp\npopq %r15\npopq %r14\npopq %r13");
+  emit_str(compiler, "popq %r12\npopq %rbp\npopq %rbx\nretq");
   compiler->emit = saved_emit;
 }
 
@@ -2727,9 +3794,16 @@ void emit_constants(compiler_t *compiler) {
     delete_exprs(all_defs);
   }
 
-  // FANCY ALGO
-  if (all_quotes)
+  // Quoted symbols are interned in the order they appear
+  if (all_quotes) {
+    for (size_t i = 0; i < all_quotes->len; i++) {
+      exprs_t *quote = all_quotes->arr[i].exprs;
+      if (quote->len == 2 && quote->arr[1].type == Symb) {
+        intern_symb(compiler, quote->arr[1].str);
+      }
+    }
     delete_exprs(all_quotes);
+  }
 }
 
 strs_t *compile(compiler_t *compiler, exprs_t *exprs, size_t heap_size,
@@ -17,6 +17,25 @@ enum emit {
   End,
 };
 
+/// @brief Write barrier emitted for stores into heap objects
+enum barrier {
+  Remset, // Records each old slot pointing into gen0
+  Card,   // Marks the card of the slot, cheaper for repeated stores
+};
+
+/// @brief Caller saved register stored in the frame around a call
+typedef struct spill_t {
+  ///> Register index in the env.
+  size_t reg;
+  ///> Frame slot holding it, -1 if the register was dead or free, and only
+  ///> needs its type back or to be released after the call.
+  ssize_t slot;
+  ///> Type to restore after the call.
+  enum val_type type;
+  ///> Stored on the root stack instead, so the gc can update it.
+  char root;
+} spill_t;
+
 /// @brief Reusable compiler object
 typedef struct compiler_t {
   ///> Sexprs to compile.
@@ -29,6 +48,12 @@ typedef struct compiler_t {
   size_t heap;
   ///> Size of the heap. Real heap usage will be higher.
   size_t heap_size;
+  ///> Write barrier mode.
+  enum barrier barrier;
+  ///> Count the objects and bytes of each allocation site.
+  char profile;
+  ///> Allocation sites counted so far.
+  size_t sites;
   ///> Latest branch label.
   size_t label;
   ///> Latest lambda label.
@@ -39,6 +64,31 @@ typedef struct compiler_t {
   enum val_type ret_type;
   ///> Arguments in case of a lambda
   struct exprs_t *ret_args;
+  ///> Registers currently spilled around calls, used as a stack.
+  struct spill_t *spills;
+  size_t spill_len;
+  size_t spill_cap;
+  ///> Frame slots in use by the spills.
+  size_t spill_slots;
+  ///> Most frame slots needed by the current function.
+  size_t spill_max;
+  ///> Current lambda label, used to name its frame size.
+  size_t frame;
+  ///> Code run after the current expression within the current function, used
+  ///> as a stack. A variable is live at a call while it is named there.
+  struct exprs_t *later;
+  size_t later_len;
+  size_t later_cap;
+  ///> First entry of later belonging to the current function.
+  size_t later_base;
+  ///> First variable of the current function, those before it being reached
+  ///> through the closure rather than their registers.
+  size_t later_vars;
+  ///> Operands of the forms being emitted, used as a stack. Each pushes what
+  ///> of it runs later itself, so it is skipped within later.
+  struct expr_t **doing;
+  size_t doing_len;
+  size_t doing_cap;
   ///> The environment to keep track of stack and vars.
   struct env_t *env;
   ///> Which buffer to emit to.
@@ -53,6 +103,8 @@ typedef struct compiler_t {
   struct strs_t *main;
   ///> The quote declarations.
   struct strs_t *quotes;
+  ///> Names of the interned symbols, the one at i being labeled symb<i>.
+  struct strs_t *symbs;
   ///> The output asm.
   struct strs_t *body;
   ///> The end of main function.
@@ -194,6 +194,10 @@ size_t get_unused_env(env_t *env) {
       return i;
     }
   }
+  // Out of registers, the reserved ones are skipped to reach the stack
+  while (env->rlen >= env->reserved_offset && env->rlen <= env->stack_offset) {
+    push_env(env, 0, 0);
+  }
   push_env(env, Unknown, 0);
   return env->rlen - 1;
 }
@@ -210,6 +214,10 @@ size_t get_unused_postn_env(env_t *env, size_t n) {
       return i;
     }
   }
+  // Out of registers, the reserved ones are skipped to reach the stack
+  while (env->rlen >= env->reserved_offset && env->rlen <= env->stack_offset) {
+    push_env(env, 0, 0);
+  }
   push_env(env, Unknown, 0);
   return env->rlen - 1;
 }
@@ -137,9 +137,21 @@ void print_err(err_t err) {
   case ExpectedAtLeastBinary:
     printf("Expected at least 2 arguments to function.");
     break;
+  case ExpectedAtLeastTrinary:
+    printf("Expected at least 3 arguments to function.");
+    break;
   case ExpectedAtMostBinary:
     printf("Expected at most 2 arguments to function.");
     break;
+  case ExpectedAtMostTrinary:
+    printf("Expected at most 3 arguments to function.");
+    break;
+  case ExpectedAtMostQuaternary:
+    printf("Expected at most 4 arguments to function.");
+    break;
+  case ExpectedAtMostQuinary:
+    printf("Expected at most 5 arguments to function.");
+    break;
   case ExpectedNoArg:
     printf("Expected 0 argument to function.");
     break;
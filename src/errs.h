@@ -48,7 +48,11 @@ enum err {
   ExpectedList,
   ExpectedAtLeastUnary,
   ExpectedAtLeastBinary,
+  ExpectedAtLeastTrinary,
   ExpectedAtMostBinary,
+  ExpectedAtMostTrinary,
+  ExpectedAtMostQuaternary,
+  ExpectedAtMostQuinary,
   ExpectedNoArg,
   ExpectedUnary,
   ExpectedBinary,
@@ -91,7 +91,6 @@ int find_symb_exprs(exprs_t *exprs, const char *symb) {
 
 exprs_t *find_all_symb_exprs(exprs_t *exprs, const char *symb) {
   exprs_t *found = create_exprs(1);
-  int inside = 0;
   for (size_t i = 0; i < exprs->len; i++) {
     switch (exprs->arr[i].type) {
     case Null:
@@ -103,10 +102,10 @@ exprs_t *find_all_symb_exprs(exprs_t *exprs, const char *symb) {
     case Vec:
       break;
     case Symb:
-      if (!inside && !strcmp(exprs->arr[i].str, symb))
+      // Only the head of a form names it
+      if (!i && !strcmp(exprs->arr[i].str, symb))
         push_exprs(found, (expr_t){.type = List, .exprs = clone_exprs(exprs)});
-      else
-        break;
+      break;
     case List: {
       exprs_t *inner = find_all_symb_exprs(exprs->arr[i].exprs, symb);
       if (inner) {
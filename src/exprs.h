@@ -50,7 +50,7 @@ int find_symb_exprs(exprs_t *exprs, const char *symb);
 
 /// @brief Recursive finder of all exprs with a given symbol
 ///
-/// Given a symbol, it recursevely searches for all its occurences and
+/// Given a symbol, it recursevely searches for all the forms it heads and
 /// returns them all as the `exprs` that contained it in a single `exprs_t`
 /// slice.
 /// @param symb Non-null char* to find.
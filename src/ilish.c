@@ -5,12 +5,39 @@
 #include <fcntl.h>
 #include <malloc.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
-const size_t heap_size = 8096;
+/// Initial heap of the compiled programs, set with --heap
+size_t heap_size = 8096;
+
+/// Parses a size in bytes with an optional k, m or g suffix
+/// @return The size, 0 if it is malformed.
+size_t parse_size(const char *str) {
+  char *end;
+  size_t size = strtoull(str, &end, 10);
+  switch (*end) {
+  case 'k':
+  case 'K':
+    size <<= 10;
+    end++;
+    break;
+  case 'm':
+  case 'M':
+    size <<= 20;
+    end++;
+    break;
+  case 'g':
+  case 'G':
+    size <<= 30;
+    end++;
+    break;
+  }
+  return *end ? 0 : size;
+}
 
 void compile_line(parser_t *parser, compiler_t *compiler, char *line) {
   exprs_t *exprs = parse(parser, line);
@@ -78,6 +105,27 @@ void compile_file(parser_t *parser, compiler_t *compiler, int file) {
 int main(int argc, char *argv[]) {
   parser_t *parser = create_parser();
   compiler_t *compiler = create_compiler();
+  // Options come first and are dropped before looking at the mode
+  while (argc > 1 && !strncmp(argv[1], "--", 2)) {
+    if (!strcmp(argv[1], "--barrier=card")) {
+      compiler->barrier = Card;
+    } else if (!strcmp(argv[1], "--barrier=remset")) {
+      compiler->barrier = Remset;
+    } else if (!strcmp(argv[1], "--profile-alloc")) {
+      compiler->profile = 1;
+    } else if (!strncmp(argv[1], "--heap=", 7)) {
+      heap_size = parse_size(argv[1] + 7);
+      if (!heap_size) {
+        puts("Invalid Heap Size, See help");
+        return 1;
+      }
+    } else {
+      break;
+    }
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
   switch (argc) {
   case 1:
     repl(parser, compiler);
@@ -86,6 +134,11 @@ int main(int argc, char *argv[]) {
     if (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help") ||
         !strcmp(argv[1], "help")) {
       puts("Use -e to compile a passed in string or -f to compile file(s).");
+      puts("Options before them: --barrier=remset (default) or "
+           "--barrier=card to pick the write barrier.");
+      puts("--heap=SIZE sets the initial heap of the program, i.e. 64m.");
+      puts("--profile-alloc makes the program report what each line "
+           "allocated at exit.");
     } else {
       puts("Unknown Argument, See help");
     }
@@ -0,0 +1,6 @@
+; expect: (3 . 3)
+; set! of a global from a function stores through its box, behind the barrier
+(define acc 0)
+(define (keep x) (set! acc (cons x x)))
+(keep 3)
+acc
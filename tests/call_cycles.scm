@@ -0,0 +1,7 @@
+; expect: ((2 3 . 1) (3 1 . 2) (2 . 1) . 135)
+; Arguments passed on in another order go through swaps and rotations
+(define (rot a b c n) (if (zero? n) (cons a (cons b c)) (rot b c a (- n 1))))
+(define (swap a b n) (if (zero? n) (cons a b) (swap b a (- n 1))))
+(define (sub a b c) (- a (* b 10) (* c 100)))
+(define (flip a b c) (sub c a b))
+(cons (rot 1 2 3 1) (cons (rot 1 2 3 5) (cons (swap 1 2 3) (flip 1 2 345))))
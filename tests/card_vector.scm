@@ -0,0 +1,15 @@
+; expect: 499500
+; env: ILISH_NURSERY=16k ILISH_HEAP=64k ILISH_GC_STATS=1
+; stderr: \([1-9][0-9]* promoting\)
+; Fresh pairs stored into a promoted vector over and over survive the minor
+; collections between the stores, found through the dirty cards or remembered
+; slots
+(define v (make-vector 1000 0))
+(define (fill i)
+  (if (= i 1000) 0 (begin (vector-set! v i (cons i i)) (fill (+ i 1)))))
+(define (churn n) (if (zero? n) 0 (begin (cons n n) (churn (- n 1)))))
+(define (sum i acc)
+  (if (= i 1000) acc (sum (+ i 1) (+ acc (car (vector-ref v i))))))
+(define (rounds r)
+  (if (zero? r) (sum 0 0) (begin (fill 0) (churn 1000) (rounds (- r 1)))))
+(rounds 20)
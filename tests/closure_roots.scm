@@ -0,0 +1,7 @@
+; expect: 6
+; Globals captured by a closure stay rooted while the closure is allocated
+(define (build n acc) (if (zero? n) acc (build (- n 1) (cons n acc))))
+(define (get i) (* i 2))
+(define big (build 41 0))
+(define (total i) (get i))
+(total 3)
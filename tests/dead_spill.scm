@@ -0,0 +1,14 @@
+; expect: 50555000
+; env: ILISH_NURSERY=1m ILISH_GC_STATS=1
+; stderr: , copied [0-9]{1,5},
+; A list no longer read is not saved around the calls after its last read, so
+; the collections within them leave it behind instead of copying its 240KB
+(define (build n acc) (if (zero? n) acc (build (- n 1) (cons n acc))))
+(define (sum l acc) (if (pair? l) (sum (cdr l) (+ acc (car l))) acc))
+(define (churn n acc)
+  (if (zero? n) acc (churn (- n 1) (+ acc (sum (build 10 0) 0)))))
+(define (f n)
+  (let ((big (build n 0)))
+    (let ((s (sum big 0)))
+      (+ s (churn 10000 0)))))
+(f 10000)
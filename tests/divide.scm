@@ -0,0 +1,9 @@
+; expect: (16 10 -10 27 2 . -3)
+; Division and modulo by constants and by variables held in rdx
+(define (div3 a b c) (/ a 3 c))
+(define (div a b c) (/ a b c))
+(define (divs a b c) (/ a (+ b 1) (- c 1) 3))
+(define (mod a b c) (modulo a c))
+(define (mod7 a b c) (modulo (- 0 a) 7))
+(cons (div3 100 5 2) (cons (div 100 5 2) (cons (div -100 5 2)
+  (cons (divs 1000 3 4) (cons (mod 100 5 7) (mod7 101 0 0))))))
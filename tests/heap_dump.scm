@@ -0,0 +1,10 @@
+; expect: 0
+; flags: --profile-alloc
+; heapstat: ^pair +1000 +24000 +24000$
+; heapstat: ^ +7 pair +1000 +24000 +24000 +48000$
+; The snapshot at exit holds the list a global still refers to, by type and by
+; the line that allocated it, and leaves out the garbage around it
+(define (build n acc) (if (zero? n) acc (build (- n 1) (cons n acc))))
+(define (churn n) (if (zero? n) 0 (begin (build 10 0) (churn (- n 1)))))
+(define keep (build 1000 0))
+(churn 100)
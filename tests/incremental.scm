@@ -0,0 +1,11 @@
+; expect: 210110000
+; env: ILISH_HEAP=1m ILISH_GC_BUDGET=1000 ILISH_GC_STATS=1
+; stderr: ^Incremental: [1-9][0-9]* cycles \(0 aborted\)
+; A budget collects gen1 in cycles that keep up with what the program
+; promotes into it meanwhile, rather than in major collections
+(define (build n acc) (if (zero? n) acc (build (- n 1) (cons n acc))))
+(define (sum l acc) (if (pair? l) (sum (cdr l) (+ acc (car l))) acc))
+(define (grow l i) (if (zero? i) l (grow (cons i l) (- i 1))))
+(define (churn l) (grow l (- 100 (* 0 (sum (build 100 0) 0)))))
+(define (loop i l) (if (zero? i) (sum l 0) (loop (- i 1) (churn l))))
+(loop 2000 (build 20000 0))
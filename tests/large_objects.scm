@@ -0,0 +1,13 @@
+; expect: (4999950000 100000 . 70000)
+; env: ILISH_NURSERY=64k ILISH_GC_STATS=1
+; stderr: ^Heap: .*, [1-9][0-9]* large$
+; Vectors and strings past 32KB are allocated in the large object space, where
+; they stay put, and the pairs stored into them survive the collections
+(define v (make-vector 100000 0))
+(define (fill i)
+  (if (= i 100000) 0 (begin (vector-set! v i (cons i i)) (fill (+ i 1)))))
+(define (sum i acc)
+  (if (= i 100000) acc (sum (+ i 1) (+ acc (car (vector-ref v i))))))
+(define (count s) (string-length (string-append s (make-string 20000 #\b))))
+(fill 0)
+(cons (sum 0 0) (cons (vector-length v) (count (make-string 50000 #\a))))
@@ -0,0 +1,6 @@
+; expect: ("ééé" #\xe9 "λλ" 8 . "zz")
+; make-string fills with the whole UTF-8 sequence of the character
+(define (fill n c) (make-string n c))
+(define (bytes s) (string-length (string-append s s s s)))
+(cons (make-string 3 #\xe9) (cons (string-ref (make-string 3 #\xe9) 0)
+  (cons (fill 2 #\x3bb) (cons (bytes (fill 2 #\x1f600)) (fill 2 #\z)))))
@@ -0,0 +1,13 @@
+; expect: 250510000
+; env: ILISH_NURSERY=64k ILISH_HEAP=64m ILISH_GC_STATS=1
+; stderr: ^Heap: 131072 bytes of gen0,
+; A nursery set with ILISH_NURSERY keeps its size, both halves here, however
+; crowded, and its survivors are promoted instead
+(define (build n acc) (if (zero? n) acc (build (- n 1) (cons n acc))))
+(define (sum l acc) (if (pair? l) (sum (cdr l) (+ acc (car l))) acc))
+(define keep (build 20000 0))
+(define (loop i acc)
+  (if (zero? i)
+      (+ acc (sum keep 0))
+      (loop (- i 1) (+ acc (sum (build 100 0) 0)))))
+(loop 10000 0)
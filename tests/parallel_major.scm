@@ -0,0 +1,11 @@
+; expect: 210110000
+; env: ILISH_GC_THREADS=4 ILISH_NURSERY=16k ILISH_HEAP=64k ILISH_GC_STATS=1
+; stderr: ^GC: .*, ([2-9]|[1-9][0-9]+) major$
+; Major collections share the copying between threads, and a live list that
+; keeps growing survives every one of them whole
+(define (build n acc) (if (zero? n) acc (build (- n 1) (cons n acc))))
+(define (sum l acc) (if (pair? l) (sum (cdr l) (+ acc (car l))) acc))
+(define (grow l i) (if (zero? i) l (grow (cons i l) (- i 1))))
+(define (churn l) (grow l (- 100 (* 0 (sum (build 100 0) 0)))))
+(define (loop i l) (if (zero? i) (sum l 0) (loop (- i 1) (churn l))))
+(loop 2000 (build 20000 0))
@@ -0,0 +1,6 @@
+; expect: (#(-23 ()) "λ" #\x61 ((() . 2) . 1) (x . #(y)) . -2305843009213693951)
+; Each kind of value prints as it reads, nested on either side of a pair
+(define (build n acc) (if (zero? n) acc (build (- n 1) (cons acc n))))
+(define (mid l) (cons (build 2 '()) (cons (cons 'x (vector 'y)) l)))
+(cons (vector -23 '())
+  (cons "λ" (cons #\a (mid (- 0 2305843009213693951)))))
@@ -0,0 +1,9 @@
+; expect: 10
+; flags: --profile-alloc
+; stderr: ^Allocation sites$
+; stderr: ^ +8 pair +10 +240$
+; stderr: ^ +7 closure +10 +240$
+; Each site counts the objects and bytes it allocates, apart from the output
+(define (f x) (lambda (y) x))
+(define (g n) (if (= n 0) 10 (begin (f n) (cons n n) (g (- n 1)))))
+(g 10)
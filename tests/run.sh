@@ -0,0 +1,66 @@
+#!/bin/sh
+# Compiles each program given, links it with the runtime, and checks that it
+# prints what its first line expects, as "; expect: OUTPUT", under both write
+# barriers and at the default and smallest nursery.
+# A program can also ask for compiler flags with "; flags: FLAGS", and for
+# its own environment with "; env: VAR=VALUE...", which then replaces the
+# nursery sizes. Each "; stderr: REGEX" must match what it prints to stderr,
+# and each "; heapstat: REGEX" what ilish-heapstat prints of its heap at exit.
+
+status=0
+
+# Checks that each of the patterns, one per line, matches the file
+match() {
+    while read -r pattern; do
+        if [ -n "$pattern" ] && ! grep -Eq -- "$pattern" "$1"; then
+            echo "FAIL $test $barrier $args: no $pattern"
+            status=1
+        fi
+    done <<EOF
+$2
+EOF
+}
+
+# Runs build/test in the environment given, checking its output
+check() {
+    args="$*"
+    if [ -n "$stats" ]; then
+        set -- ILISH_HEAP_DUMP_ON_EXIT=build/test.heap "$@"
+    fi
+    out=$(env "$@" ./build/test 2> build/test.err)
+    if [ "$out" != "$expect" ]; then
+        echo "FAIL $test $barrier $args: $out"
+        status=1
+    fi
+    match build/test.err "$patterns"
+    if [ -n "$stats" ]; then
+        ./build/release/ilish-heapstat build/test.heap > build/test.stat
+        match build/test.stat "$stats"
+    fi
+}
+
+for test in "$@"; do
+    expect=$(sed -n '1s/^; expect: //p' "$test")
+    flags=$(sed -n 's/^; flags: //p' "$test")
+    envs=$(sed -n 's/^; env: //p' "$test")
+    patterns=$(sed -n 's/^; stderr: //p' "$test")
+    stats=$(sed -n 's/^; heapstat: //p' "$test")
+    for barrier in "" "--barrier=card"; do
+        if ! ./build/release/ilish $barrier $flags -e "$(cat "$test")" \
+                > build/test.s ||
+            ! cc -z noexecstack build/test.s build/runtime/runtime.o \
+                -o build/test; then
+            echo "FAIL $test $barrier: build"
+            status=1
+            continue
+        fi
+        if [ -n "$envs" ]; then
+            check $envs
+        else
+            check ILISH_NURSERY=
+            check ILISH_NURSERY=16
+        fi
+    done
+done
+rm -f build/test build/test.s build/test.err build/test.heap build/test.stat
+exit $status
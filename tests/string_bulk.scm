@@ -0,0 +1,18 @@
+; expect: ("aé€😀b" "é€😀" "aλλa" "xxaa" "aé€a" "aabcé" "éé€😀b" "aaéé" . 0)
+; The bulk string primitives copy and fill UTF-8 strings in place when the
+; bytes keep their width and into cells when they don't, and string-copy!
+; moves overlapping characters as if through a temporary
+(define (shift s) (string-copy! s 1 s 0 3) s)
+(define (edit n s)
+  (if (= n 0) (string-append "aé" "€" "😀b")
+  (if (= n 1) (substring "aé€😀b" 1 4)
+  (if (= n 2) (begin (string-fill! s #\x3bb 1 3) s)
+  (if (= n 3) (begin (string-fill! s #\x 0 2) s)
+  (if (= n 4) (begin (string-copy! s 1 "é€x" 0 2) s)
+  (if (= n 5) (shift (string-copy "zabcdé" 1))
+  (if (= n 6) (shift (string-copy "é€😀ab"))
+    (begin (string-fill! s #\xe9 10) (string-copy! s 0 s 5)
+      (substring s 3 7))))))))))
+(define (fresh n) (edit n (make-string (if (= n 7) 1000 4) #\a)))
+(define (all n l) (if (< n 0) l (all (- n 1) (cons (fresh n) l))))
+(all 7 0)
@@ -0,0 +1,8 @@
+; expect: ("éa" "λaλ" "bab" #t 3 . #t)
+; string lays out each character at its UTF-8 width
+(define (mix c) (string c #\a c))
+(define s (make-string 2 #\a))
+(string-set! s 0 #\xe9)
+(cons (string #\xe9 #\a) (cons (mix #\x3bb) (cons (mix #\b)
+  (cons (string=? (string #\xe9 #\a) s) (cons (string-length (mix #\xe9))
+    (= (string-hash s) (string-hash (string #\xe9 #\a))))))))
@@ -0,0 +1,19 @@
+; expect: (#t #f #f #t #t #t #t #f #t #t . 0)
+; string=?, string<? and string-hash look at the whole of long strings, which
+; compare and hash the same by their characters whether held as UTF-8 or in
+; the cells a width changing string-set! leaves them in
+(define (long n c) (let ((s (make-string 1000 #\a))) (string-set! s n c) s))
+(define (spliced) (string-append (make-string 3 #\a) "λ" (make-string 996 #\a)))
+(define (test n)
+  (if (= n 0) (string=? (long 999 #\b) (long 999 #\b))
+  (if (= n 1) (string=? (long 999 #\b) (long 998 #\b))
+  (if (= n 2) (string<? (long 500 #\b) (long 501 #\b))
+  (if (= n 3) (string<? (long 501 #\b) (long 500 #\b))
+  (if (= n 4) (string<? (make-string 999 #\a) (make-string 1000 #\a))
+  (if (= n 5) (string=? (long 3 #\x3bb) (spliced))
+  (if (= n 6) (= (string-hash (long 3 #\x3bb)) (string-hash (spliced)))
+  (if (= n 7) (= (string-hash (long 999 #\b)) (string-hash (long 998 #\b)))
+  (if (= n 8) (string<? (long 700 #\xe9) (long 700 #\x20ac))
+    (string<? (long 3 #\x3bb) (string-append "aaa" "😀"))))))))))))
+(define (all n l) (if (< n 0) l (all (- n 1) (cons (test n) l))))
+(all 9 0)
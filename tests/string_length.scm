@@ -0,0 +1,11 @@
+; expect: (3003 5120 4097 . 4097)
+; string-length counts code points of strings many kilobytes long, built from
+; characters of every UTF-8 width and at lengths off any block size
+(define (wide n)
+  (string-append (make-string n #\x3bb) (make-string n #\x1f600)))
+(define (mixed n) (string-append (make-string n #\a) (wide n)))
+(define (grow s n) (if (zero? n) s (grow (string-append s s) (- n 1))))
+(define s (make-string 4097 #\a))
+(string-set! s 4096 #\x20ac)
+(cons (string-length (mixed 1001)) (cons (string-length (grow "aé€😀x" 10))
+  (cons (string-length (make-string 4097 #\xe9)) (string-length s))))
@@ -0,0 +1,17 @@
+; expect: (#\x1f600 #\xe9 1020 . 1000)
+; string-ref finds code points of long UTF-8 strings in sequence, at random
+; and across two strings looked up in turn, each a unit repeated
+(define (grow s n) (if (zero? n) s (grow (string-append s s) (- n 1))))
+(define (walk s i n)
+  (if (= i 1020) n
+    (walk s (+ i 1)
+      (if (eq? (string-ref s i) (string-ref s (+ i 4))) (+ n 1) n))))
+(define (jump s t i k)
+  (if (zero? k) 0
+    (+ (if (eq? (string-ref s (+ i 2)) (string-ref t i)) 1 0)
+      (jump s t (modulo (+ (* i 37) 11) 1000) (- k 1)))))
+(define (run s)
+  (let ((t (substring s 2 1024)))
+    (cons (string-ref s 1023)
+      (cons (string-ref t 1019) (cons (walk s 0 0) (jump s t 5 1000))))))
+(run (grow "aé€😀" 8))
@@ -0,0 +1,16 @@
+; expect: (#t #t #t #f "λx" "syé" #f #t . 0)
+; string->symbol gives the same symbol for equal names, however and whenever
+; their strings were built, so that eq? compares symbols by address
+(define (name n) (string->symbol (string-append "sy" (make-string n #\xe9))))
+(define (churn n) (if (zero? n) (name 3) (if (symbol? (name (modulo n 50)))
+  (churn (- n 1)) #f)))
+(define (test n)
+  (if (= n 0) (eq? (string->symbol "abc") 'abc)
+  (if (= n 1) (eq? (name 2) (name 2))
+  (if (= n 2) (eq? (name 2) (name 3))
+  (if (= n 3) (symbol->string 'λx)
+  (if (= n 4) (symbol->string (name 1))
+  (if (= n 5) (symbol? (symbol->string 'a))
+    (eq? (churn 5000) (name 3)))))))))
+(define (all n l) (if (< n 0) l (all (- n 1) (cons (test n) l))))
+(cons (eq? 'syéé (name 2)) (all 6 0))
@@ -0,0 +1,13 @@
+; expect: 250510000
+; env: ILISH_HEAP=1m ILISH_GC_STATS=1
+; stderr: \([1-9][0-9]* promoting\)
+; Survivors that outlive a few minor collections are promoted, rather than
+; copied from one nursery half to the other at every one of them
+(define (build n acc) (if (zero? n) acc (build (- n 1) (cons n acc))))
+(define (sum l acc) (if (pair? l) (sum (cdr l) (+ acc (car l))) acc))
+(define keep (build 20000 0))
+(define (loop i acc)
+  (if (zero? i)
+      (+ acc (sum keep 0))
+      (loop (- i 1) (+ acc (sum (build 100 0) 0)))))
+(loop 10000 0)
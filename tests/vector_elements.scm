@@ -0,0 +1,7 @@
+; expect: (#(y 2 (1 . 2) 5) . #((3 . 3) #(3 (3 . 1)) "aa"))
+; vector computes its elements before allocating, so that neither they nor a
+; collection within them lose the vector
+(define (f x) (* x 2))
+(define y 5)
+(define (g n) (vector (cons n n) (vector n (cons n 1)) (make-string 2 #\a)))
+(cons (vector 'y (f 1) (cons 1 2) y) (g 3))
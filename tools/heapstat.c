@@ -0,0 +1,349 @@
+/// @file heapstat.c
+/// @brief Offline summary of the heap snapshots the runtime writes
+///
+/// Prints the objects of a snapshot by type, and by allocation site for
+/// programs compiled with --profile-alloc, along with the bytes they retain:
+/// what the heap would shrink by if they were unreachable. Retained sizes
+/// come from the dominator tree of the objects reachable from the roots.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../runtime/object.h"
+
+#define NONE ((size_t)-1)
+
+/// A snapshot, with objects numbered from 1 as node 0 stands for the roots
+typedef struct {
+  size_t *sites;
+  size_t site_len;
+  size_t len;
+  size_t *hdr;
+  /// Successors of each node, as [succ_begin[n], succ_begin[n + 1])
+  size_t *succ_begin;
+  size_t *succ;
+} snapshot_t;
+
+/// Group statistics, by type or by site
+typedef struct {
+  size_t key;
+  size_t objects;
+  size_t bytes;
+  size_t retained;
+} group_t;
+
+const char *type_names[] = {"", "pair", "vector", "string", "box", "symbol",
+                            "closure", ""};
+
+size_t *read_file(const char *path, size_t *len) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return 0;
+  }
+  fseek(file, 0, SEEK_END);
+  size_t size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  size_t *words = malloc(size + sizeof(size_t));
+  *len = fread(words, sizeof(size_t), size / sizeof(size_t), file);
+  fclose(file);
+  return words;
+}
+
+int cmp_addr(const void *a, const void *b) {
+  const size_t *x = a;
+  const size_t *y = b;
+  return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+/// Finds the node of the object at `addr` among the sorted pairs of address
+/// and node
+size_t find_node(size_t *by_addr, size_t len, size_t addr) {
+  size_t lo = 0;
+  size_t hi = len;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (by_addr[mid * 2] < addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < len && by_addr[lo * 2] == addr ? by_addr[lo * 2 + 1] : NONE;
+}
+
+/// Parses the words of a snapshot into nodes and edges, dropping references
+/// to anything but a recorded object
+/// @return Whether the snapshot is well formed.
+int parse(snapshot_t *snap, size_t *words, size_t len) {
+  if (len < 3 || words[0] != HEAP_DUMP_MAGIC) {
+    return 0;
+  }
+  size_t i = 1;
+  snap->site_len = words[i++];
+  snap->sites = words + i;
+  i += snap->site_len * 4;
+  if (i >= len || i + words[i] >= len) {
+    return 0;
+  }
+  size_t roots = i;
+  i += words[i] + 1;
+  size_t objects = i;
+  size_t refs = words[roots];
+  snap->len = 1;
+  while (i < len) {
+    if (i + 3 > len || i + 3 + words[i + 2] > len) {
+      return 0;
+    }
+    refs += words[i + 2];
+    snap->len++;
+    i += 3 + words[i + 2];
+  }
+  snap->hdr = calloc(snap->len, sizeof(size_t));
+  size_t *by_addr = malloc(snap->len * 2 * sizeof(size_t));
+  i = objects;
+  for (size_t n = 1; n < snap->len; n++) {
+    snap->hdr[n] = words[i + 1];
+    by_addr[(n - 1) * 2] = words[i];
+    by_addr[(n - 1) * 2 + 1] = n;
+    i += 3 + words[i + 2];
+  }
+  qsort(by_addr, snap->len - 1, 2 * sizeof(size_t), cmp_addr);
+  snap->succ_begin = malloc((snap->len + 1) * sizeof(size_t));
+  snap->succ = malloc((refs + 1) * sizeof(size_t));
+  size_t e = 0;
+  i = objects;
+  for (size_t n = 0; n < snap->len; n++) {
+    size_t *ref = n ? words + i + 3 : words + roots + 1;
+    size_t ref_len = n ? words[i + 2] : words[roots];
+    snap->succ_begin[n] = e;
+    for (size_t r = 0; r < ref_len; r++) {
+      size_t to = find_node(by_addr, snap->len - 1, ref[r]);
+      if (to != NONE) {
+        snap->succ[e++] = to;
+      }
+    }
+    if (n) {
+      i += 3 + ref_len;
+    }
+  }
+  snap->succ_begin[snap->len] = e;
+  free(by_addr);
+  return 1;
+}
+
+/// Numbers the nodes reachable from the roots in depth first post order
+/// @return How many there are, listed in `order`.
+size_t post_order(snapshot_t *snap, size_t *order, size_t *post) {
+  size_t *stack = malloc(snap->len * 2 * sizeof(size_t));
+  size_t top = 0;
+  size_t count = 0;
+  for (size_t n = 0; n < snap->len; n++) {
+    post[n] = NONE;
+  }
+  // Reached but unnumbered nodes are kept apart from unreached ones
+  post[0] = NONE - 1;
+  stack[top++] = 0;
+  stack[top++] = snap->succ_begin[0];
+  while (top) {
+    size_t n = stack[top - 2];
+    size_t e = stack[top - 1];
+    if (e == snap->succ_begin[n + 1]) {
+      post[n] = count;
+      order[count++] = n;
+      top -= 2;
+      continue;
+    }
+    stack[top - 1]++;
+    size_t to = snap->succ[e];
+    if (post[to] == NONE) {
+      post[to] = NONE - 1;
+      stack[top++] = to;
+      stack[top++] = snap->succ_begin[to];
+    }
+  }
+  free(stack);
+  return count;
+}
+
+size_t intersect(size_t *idom, size_t *post, size_t a, size_t b) {
+  while (a != b) {
+    while (post[a] < post[b]) {
+      a = idom[a];
+    }
+    while (post[b] < post[a]) {
+      b = idom[b];
+    }
+  }
+  return a;
+}
+
+/// Finds the immediate dominator of each reachable node, iterating to a fixed
+/// point over the predecessors in reverse post order (Cooper, Harvey and
+/// Kennedy)
+void dominators(snapshot_t *snap, size_t *order, size_t count, size_t *post,
+                size_t *idom) {
+  size_t *pred_begin = calloc(snap->len + 1, sizeof(size_t));
+  for (size_t e = 0; e < snap->succ_begin[snap->len]; e++) {
+    pred_begin[snap->succ[e] + 1]++;
+  }
+  for (size_t n = 0; n < snap->len; n++) {
+    pred_begin[n + 1] += pred_begin[n];
+  }
+  size_t *pred = malloc((pred_begin[snap->len] + 1) * sizeof(size_t));
+  size_t *fill = malloc(snap->len * sizeof(size_t));
+  memcpy(fill, pred_begin, snap->len * sizeof(size_t));
+  for (size_t n = 0; n < snap->len; n++) {
+    for (size_t e = snap->succ_begin[n]; e < snap->succ_begin[n + 1]; e++) {
+      pred[fill[snap->succ[e]]++] = n;
+    }
+  }
+  for (size_t n = 0; n < snap->len; n++) {
+    idom[n] = NONE;
+  }
+  idom[0] = 0;
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (size_t i = count - 1; i-- > 0;) {
+      size_t n = order[i];
+      size_t dom = NONE;
+      for (size_t e = pred_begin[n]; e < pred_begin[n + 1]; e++) {
+        size_t p = pred[e];
+        if (idom[p] == NONE) {
+          continue;
+        }
+        dom = dom == NONE ? p : intersect(idom, post, p, dom);
+      }
+      if (idom[n] != dom) {
+        idom[n] = dom;
+        changed = 1;
+      }
+    }
+  }
+  free(fill);
+  free(pred);
+  free(pred_begin);
+}
+
+int cmp_retained(const void *a, const void *b) {
+  const group_t *x = a;
+  const group_t *y = b;
+  if (x->retained != y->retained) {
+    return (x->retained < y->retained) - (x->retained > y->retained);
+  }
+  return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+/// Sums the reachable objects of each group, counting toward its retained
+/// bytes only those not immediately dominated by another of the group, so
+/// that chains of them, like the pairs of a list, are counted once
+group_t *group_by(snapshot_t *snap, size_t *idom, size_t *retained,
+                  size_t (*key)(size_t hdr), size_t keys) {
+  group_t *groups = calloc(keys, sizeof(group_t));
+  for (size_t k = 0; k < keys; k++) {
+    groups[k].key = k;
+  }
+  for (size_t n = 1; n < snap->len; n++) {
+    if (idom[n] == NONE) {
+      continue;
+    }
+    group_t *group = groups + key(snap->hdr[n]);
+    group->objects++;
+    group->bytes += hdr_words(snap->hdr[n]) * sizeof(size_t);
+    if (!idom[n] || key(snap->hdr[idom[n]]) != group->key) {
+      group->retained += retained[n];
+    }
+  }
+  qsort(groups, keys, sizeof(group_t), cmp_retained);
+  return groups;
+}
+
+size_t type_key(size_t hdr) { return hdr_type(hdr); }
+
+/// Closures keep their arity where other objects keep their site, so they
+/// are grouped with the objects the runtime allocates, under no site
+size_t site_key(size_t hdr) {
+  return hdr_type(hdr) == OBJ_LAMB ? 0 : hdr_site(hdr);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+    puts("Usage: ilish-heapstat FILE, where FILE is a heap snapshot.");
+    puts("Programs write one on SIGUSR1, or at exit to the file named by "
+         "ILISH_HEAP_DUMP_ON_EXIT.");
+    return argc != 2;
+  }
+  size_t len;
+  size_t *words = read_file(argv[1], &len);
+  if (!words) {
+    return 1;
+  }
+  snapshot_t snap;
+  if (!parse(&snap, words, len)) {
+    printf("%s is not a heap snapshot\n", argv[1]);
+    free(words);
+    return 1;
+  }
+  size_t *order = malloc(snap.len * sizeof(size_t));
+  size_t *post = malloc(snap.len * sizeof(size_t));
+  size_t *idom = malloc(snap.len * sizeof(size_t));
+  size_t *retained = calloc(snap.len, sizeof(size_t));
+  size_t count = post_order(&snap, order, post);
+  dominators(&snap, order, count, post, idom);
+  // Dominators come after what they dominate in post order
+  size_t total = 0;
+  for (size_t n = 1; n < snap.len; n++) {
+    total += hdr_words(snap.hdr[n]) * sizeof(size_t);
+  }
+  for (size_t i = 0; i + 1 < count; i++) {
+    size_t n = order[i];
+    retained[n] += hdr_words(snap.hdr[n]) * sizeof(size_t);
+    retained[idom[n]] += retained[n];
+  }
+  printf("%zu objects, %zu bytes, of which %zu objects and %zu bytes are "
+         "unreachable\n\n",
+         snap.len - 1, total, snap.len - count, total - retained[0]);
+
+  group_t *types = group_by(&snap, idom, retained, type_key, 8);
+  printf("%-8s %12s %14s %14s\n", "type", "objects", "bytes", "retained");
+  for (size_t k = 0; k < 8 && types[k].objects; k++) {
+    printf("%-8s %12zu %14zu %14zu\n", type_names[types[k].key],
+           types[k].objects, types[k].bytes, types[k].retained);
+  }
+  free(types);
+
+  if (snap.site_len) {
+    group_t *sites =
+        group_by(&snap, idom, retained, site_key, snap.site_len + 1);
+    printf("\nSites, where ? is closures and runtime allocations, which "
+           "record none\n");
+    printf("%8s %-8s %12s %14s %14s %14s\n", "line", "type", "objects",
+           "bytes", "retained", "allocated");
+    for (size_t k = 0; k <= snap.site_len && sites[k].objects; k++) {
+      if (!sites[k].key) {
+        printf("%8s %-8s", "?", "");
+      } else {
+        size_t *site = snap.sites + (sites[k].key - 1) * 4;
+        printf("%8zu %-8s", site[2], type_names[site[3] & HDR_TYPE]);
+      }
+      printf(" %12zu %14zu %14zu", sites[k].objects, sites[k].bytes,
+             sites[k].retained);
+      if (sites[k].key) {
+        printf(" %14zu", snap.sites[(sites[k].key - 1) * 4 + 1]);
+      }
+      putchar('\n');
+    }
+    free(sites);
+  }
+
+  free(retained);
+  free(idom);
+  free(post);
+  free(order);
+  free(snap.succ);
+  free(snap.succ_begin);
+  free(snap.hdr);
+  free(words);
+  return 0;
+}